@@ -55,6 +55,84 @@ namespace Dav1dfile
 			I444
 		}
 
+		public enum FrameType
+		{
+			Key,
+			Inter,
+			IntraOnly,
+			Switch
+		}
+
+		[StructLayout(LayoutKind.Sequential)]
+		public struct FrameInfo
+		{
+			public ulong offset;
+			public uint size;
+			public FrameType frameType;
+			public byte keyFrame;
+			public byte showExistingFrame;
+			public byte refreshFrameFlags;
+			public ulong presentationTime;
+		}
+
+		public enum TimingSource
+		{
+			None,
+			PictureInterval,
+			PresentationTime
+		}
+
+		[StructLayout(LayoutKind.Sequential)]
+		public struct FrameTiming
+		{
+			public uint frame;
+			public ulong presentationTime;
+			public ulong duration;
+			public double presentationSeconds;
+			public double durationSeconds;
+			public TimingSource source;
+		}
+
+		[Flags]
+		public enum InloopFilter : uint
+		{
+			None = 0,
+			Deblock = 1,
+			Cdef = 2,
+			Restoration = 4,
+			All = 7
+		}
+
+		public enum RGBAFormat
+		{
+			RGBA,
+			BGRA
+		}
+
+		public enum DecodeFrameType : uint
+		{
+			All,
+			Reference,
+			Intra,
+			Key
+		}
+
+		[StructLayout(LayoutKind.Sequential)]
+		public struct DecoderSettings
+		{
+			public int threadCount;
+			public int maxFrameDelay;
+			public int operatingPoint;
+			public byte allLayers;
+			public byte applyGrain;
+			public uint frameSizeLimit;
+			public InloopFilter inloopFilters;
+			public DecodeFrameType decodeFrameType;
+		}
+
+		[DllImport(nativeLibName, CallingConvention = CallingConvention.Cdecl)]
+		public extern static void df_default_decoder_settings(out DecoderSettings settings);
+
 		[DllImport(nativeLibName, CallingConvention = CallingConvention.Cdecl)]
 		public extern static int df_open_from_memory(
 			IntPtr bytes,
@@ -62,6 +140,21 @@ namespace Dav1dfile
 			out IntPtr context
 		);
 
+		[DllImport(nativeLibName, CallingConvention = CallingConvention.Cdecl)]
+		public extern static int df_open_from_memory64(
+			IntPtr bytes,
+			ulong size,
+			out IntPtr context
+		);
+
+		[DllImport(nativeLibName, CallingConvention = CallingConvention.Cdecl)]
+		public extern static int df_open_ex(
+			IntPtr bytes,
+			ulong size,
+			ref DecoderSettings settings,
+			out IntPtr context
+		);
+
 		[DllImport(nativeLibName, EntryPoint = "df_fopen", CallingConvention = CallingConvention.Cdecl)]
 		private static extern unsafe int INTERNAL_df_fopen(
 			[MarshalAs(UnmanagedType.LPStr)] string fname,
@@ -74,9 +167,124 @@ namespace Dav1dfile
 			out IntPtr context
 		);
 
+		[DllImport(nativeLibName, EntryPoint = "df_fopen_ex", CallingConvention = CallingConvention.Cdecl)]
+		private static extern unsafe int INTERNAL_df_fopen_ex(
+			[MarshalAs(UnmanagedType.LPStr)] string fname,
+			ref DecoderSettings settings,
+			out IntPtr context
+		);
+
+		[DllImport(nativeLibName, EntryPoint = "df_fopen_ex", CallingConvention = CallingConvention.Cdecl)]
+		private static extern unsafe int INTERNAL_df_fopen_ex(
+			byte* fname,
+			ref DecoderSettings settings,
+			out IntPtr context
+		);
+
+		[DllImport(nativeLibName, EntryPoint = "df_mmap_open", CallingConvention = CallingConvention.Cdecl)]
+		private static extern unsafe int INTERNAL_df_mmap_open(
+			[MarshalAs(UnmanagedType.LPStr)] string fname,
+			out IntPtr context
+		);
+
+		[DllImport(nativeLibName, EntryPoint = "df_mmap_open", CallingConvention = CallingConvention.Cdecl)]
+		private static extern unsafe int INTERNAL_df_mmap_open(
+			byte* fname,
+			out IntPtr context
+		);
+
+		[DllImport(nativeLibName, EntryPoint = "df_mmap_open_ex", CallingConvention = CallingConvention.Cdecl)]
+		private static extern unsafe int INTERNAL_df_mmap_open_ex(
+			[MarshalAs(UnmanagedType.LPStr)] string fname,
+			ref DecoderSettings settings,
+			out IntPtr context
+		);
+
+		[DllImport(nativeLibName, EntryPoint = "df_mmap_open_ex", CallingConvention = CallingConvention.Cdecl)]
+		private static extern unsafe int INTERNAL_df_mmap_open_ex(
+			byte* fname,
+			ref DecoderSettings settings,
+			out IntPtr context
+		);
+
+		[UnmanagedFunctionPointer(CallingConvention.Cdecl)]
+		public delegate UIntPtr df_read_func(
+			IntPtr userdata,
+			IntPtr buffer,
+			UIntPtr size
+		);
+
+		[UnmanagedFunctionPointer(CallingConvention.Cdecl)]
+		public delegate int df_seek_func(
+			IntPtr userdata,
+			ulong offset
+		);
+
+		/* Keep the delegates alive until df_close! */
+		[DllImport(nativeLibName, CallingConvention = CallingConvention.Cdecl)]
+		public extern static int df_open_from_callbacks(
+			df_read_func read,
+			df_seek_func seek,
+			IntPtr userdata,
+			out IntPtr context
+		);
+
+		/* Keep the delegates alive until df_close! */
+		[DllImport(nativeLibName, CallingConvention = CallingConvention.Cdecl)]
+		public extern static int df_open_from_callbacks_ex(
+			df_read_func read,
+			df_seek_func seek,
+			IntPtr userdata,
+			ref DecoderSettings settings,
+			out IntPtr context
+		);
+
 		[DllImport(nativeLibName, CallingConvention = CallingConvention.Cdecl)]
 		public extern static void df_close(IntPtr context);
 
+		[StructLayout(LayoutKind.Sequential)]
+		public struct PictureBuffer
+		{
+			public int width;
+			public int height;
+			public PixelLayout pixelLayout;
+			public byte hbd;
+			public IntPtr yPlane;
+			public IntPtr uPlane;
+			public IntPtr vPlane;
+			public uint yStride;
+			public uint uvStride;
+			public IntPtr allocatorData;
+		}
+
+		[UnmanagedFunctionPointer(CallingConvention.Cdecl)]
+		public delegate int df_alloc_picture_func(
+			IntPtr userdata,
+			ref PictureBuffer buffer
+		);
+
+		[UnmanagedFunctionPointer(CallingConvention.Cdecl)]
+		public delegate void df_release_picture_func(
+			IntPtr userdata,
+			ref PictureBuffer buffer
+		);
+
+		/* Called from decoder threads. Keep the delegates alive until every frame is released! */
+		[DllImport(nativeLibName, CallingConvention = CallingConvention.Cdecl)]
+		public extern static int df_set_picture_allocator(
+			IntPtr context,
+			df_alloc_picture_func alloc,
+			df_release_picture_func release,
+			IntPtr userdata
+		);
+
+		[DllImport(nativeLibName, CallingConvention = CallingConvention.Cdecl)]
+		public extern static void df_picture_pool_stats(
+			IntPtr context,
+			out ulong hits,
+			out ulong misses
+		);
+
 		[DllImport(nativeLibName, CallingConvention = CallingConvention.Cdecl)]
 		public extern static void df_videoinfo(
 			IntPtr context,
@@ -94,6 +302,27 @@ namespace Dav1dfile
 			out byte hbd
 		);
 
+		[DllImport(nativeLibName, CallingConvention = CallingConvention.Cdecl)]
+		public extern static int df_set_operating_point(IntPtr context, int operatingPoint);
+
+		[DllImport(nativeLibName, CallingConvention = CallingConvention.Cdecl)]
+		public extern static int df_set_decode_quality(IntPtr context, InloopFilter inloopFilters, byte applyGrain);
+
+		[DllImport(nativeLibName, CallingConvention = CallingConvention.Cdecl)]
+		public extern static void df_framesize(
+			IntPtr context,
+			out int width,
+			out int height,
+			out int renderWidth,
+			out int renderHeight
+		);
+
+		[DllImport(nativeLibName, CallingConvention = CallingConvention.Cdecl)]
+		public extern static void df_set_render_crop(IntPtr context, byte enabled);
+
+		[DllImport(nativeLibName, CallingConvention = CallingConvention.Cdecl)]
+		public extern static int df_frametiming(IntPtr context, out FrameTiming timing);
+
 		[DllImport(nativeLibName, CallingConvention = CallingConvention.Cdecl)]
 		public extern static int df_guessframerate(
 			IntPtr context,
@@ -106,6 +335,71 @@ namespace Dav1dfile
 		[DllImport(nativeLibName, CallingConvention = CallingConvention.Cdecl)]
 		public extern static void df_reset(IntPtr context);
 
+		[DllImport(nativeLibName, CallingConvention = CallingConvention.Cdecl)]
+		public extern static void df_set_loop(IntPtr context, byte enabled);
+
+		[DllImport(nativeLibName, CallingConvention = CallingConvention.Cdecl)]
+		public extern static int df_queue_memory(
+			IntPtr context,
+			IntPtr bytes,
+			ulong size
+		);
+
+		[DllImport(nativeLibName, EntryPoint = "df_queue_file", CallingConvention = CallingConvention.Cdecl)]
+		private static extern unsafe int INTERNAL_df_queue_file(
+			IntPtr context,
+			[MarshalAs(UnmanagedType.LPStr)] string fname
+		);
+
+		[DllImport(nativeLibName, EntryPoint = "df_queue_file", CallingConvention = CallingConvention.Cdecl)]
+		private static extern unsafe int INTERNAL_df_queue_file(
+			IntPtr context,
+			byte* fname
+		);
+
+		[DllImport(nativeLibName, CallingConvention = CallingConvention.Cdecl)]
+		public extern static uint df_queue_length(IntPtr context);
+
+		[DllImport(nativeLibName, CallingConvention = CallingConvention.Cdecl)]
+		public extern static int df_build_index(IntPtr context, byte background);
+
+		[DllImport(nativeLibName, CallingConvention = CallingConvention.Cdecl)]
+		public extern static int df_frame_count(IntPtr context, out uint count);
+
+		[DllImport(nativeLibName, CallingConvention = CallingConvention.Cdecl)]
+		public extern static int df_frame_info(
+			IntPtr context,
+			uint frame,
+			out FrameInfo info
+		);
+
+		[DllImport(nativeLibName, CallingConvention = CallingConvention.Cdecl)]
+		public extern static int df_seek(IntPtr context, uint frame);
+
+		[DllImport(nativeLibName, EntryPoint = "df_write_index", CallingConvention = CallingConvention.Cdecl)]
+		private static extern unsafe int INTERNAL_df_write_index(
+			IntPtr context,
+			[MarshalAs(UnmanagedType.LPStr)] string fname
+		);
+
+		[DllImport(nativeLibName, EntryPoint = "df_write_index", CallingConvention = CallingConvention.Cdecl)]
+		private static extern unsafe int INTERNAL_df_write_index(
+			IntPtr context,
+			byte* fname
+		);
+
+		[DllImport(nativeLibName, EntryPoint = "df_load_index", CallingConvention = CallingConvention.Cdecl)]
+		private static extern unsafe int INTERNAL_df_load_index(
+			IntPtr context,
+			[MarshalAs(UnmanagedType.LPStr)] string fname
+		);
+
+		[DllImport(nativeLibName, EntryPoint = "df_load_index", CallingConvention = CallingConvention.Cdecl)]
+		private static extern unsafe int INTERNAL_df_load_index(
+			IntPtr context,
+			byte* fname
+		);
+
 		[DllImport(nativeLibName, CallingConvention = CallingConvention.Cdecl)]
 		public extern static int df_readvideo(
 			IntPtr context,
@@ -119,6 +413,142 @@ namespace Dav1dfile
 			out uint uvStride
 		);
 
+		[DllImport(nativeLibName, CallingConvention = CallingConvention.Cdecl)]
+		public extern static int df_read_for_time(
+			IntPtr context,
+			double time,
+			out uint framesDropped,
+			out IntPtr yDataPtr,
+			out IntPtr uDataPtr,
+			out IntPtr vDataPtr,
+			out uint yDataLength,
+			out uint uvDataLength,
+			out uint yStride,
+			out uint uvStride
+		);
+
+		[DllImport(nativeLibName, CallingConvention = CallingConvention.Cdecl)]
+		public extern static int df_pool_create(int threadCount, out IntPtr pool);
+
+		[DllImport(nativeLibName, CallingConvention = CallingConvention.Cdecl)]
+		public extern static void df_pool_destroy(IntPtr pool);
+
+		[DllImport(nativeLibName, CallingConvention = CallingConvention.Cdecl)]
+		public extern static int df_pool_attach(
+			IntPtr pool,
+			IntPtr context,
+			int framesAhead
+		);
+
+		[DllImport(nativeLibName, CallingConvention = CallingConvention.Cdecl)]
+		public extern static int df_start_async(IntPtr context, int framesAhead);
+
+		[DllImport(nativeLibName, CallingConvention = CallingConvention.Cdecl)]
+		public extern static int df_acquire_frame(
+			IntPtr context,
+			out IntPtr yDataPtr,
+			out IntPtr uDataPtr,
+			out IntPtr vDataPtr,
+			out uint yDataLength,
+			out uint uvDataLength,
+			out uint yStride,
+			out uint uvStride
+		);
+
+		[DllImport(nativeLibName, CallingConvention = CallingConvention.Cdecl)]
+		public extern static void df_release_frame(IntPtr context);
+
+		[DllImport(nativeLibName, CallingConvention = CallingConvention.Cdecl)]
+		public extern static int df_readvideo_rgba(
+			IntPtr context,
+			int numFrames,
+			IntPtr rgba,
+			uint stride,
+			RGBAFormat format
+		);
+
+		[DllImport(nativeLibName, CallingConvention = CallingConvention.Cdecl)]
+		public extern static int df_readvideo_semiplanar(
+			IntPtr context,
+			int numFrames,
+			IntPtr yData,
+			uint yStride,
+			IntPtr uvData,
+			uint uvStride
+		);
+
+		[DllImport(nativeLibName, CallingConvention = CallingConvention.Cdecl)]
+		public extern static int df_readvideo_8bit(
+			IntPtr context,
+			int numFrames,
+			IntPtr yData,
+			IntPtr uData,
+			IntPtr vData,
+			uint yStride,
+			uint uvStride,
+			byte dither
+		);
+
+		[DllImport(nativeLibName, CallingConvention = CallingConvention.Cdecl)]
+		public extern static int df_readvideo_packed(
+			IntPtr context,
+			int numFrames,
+			IntPtr yData,
+			IntPtr uData,
+			IntPtr vData,
+			uint alignment,
+			out uint yDataLength,
+			out uint uvDataLength,
+			out uint yStride,
+			out uint uvStride
+		);
+
+		[DllImport(nativeLibName, CallingConvention = CallingConvention.Cdecl)]
+		public extern static int df_readvideo_scaled(
+			IntPtr context,
+			int numFrames,
+			IntPtr yData,
+			IntPtr uData,
+			IntPtr vData,
+			int width,
+			int height,
+			uint yStride,
+			uint uvStride
+		);
+
+		[DllImport(nativeLibName, CallingConvention = CallingConvention.Cdecl)]
+		public extern static int df_read_frame(IntPtr context, int numFrames, out IntPtr frame);
+
+		[DllImport(nativeLibName, CallingConvention = CallingConvention.Cdecl)]
+		public extern static void df_frame_ref(IntPtr frame);
+
+		[DllImport(nativeLibName, CallingConvention = CallingConvention.Cdecl)]
+		public extern static void df_frame_unref(IntPtr frame);
+
+		[DllImport(nativeLibName, CallingConvention = CallingConvention.Cdecl)]
+		public extern static void df_frame_planes(
+			IntPtr frame,
+			out IntPtr yDataPtr,
+			out IntPtr uDataPtr,
+			out IntPtr vDataPtr,
+			out uint yDataLength,
+			out uint uvDataLength,
+			out uint yStride,
+			out uint uvStride
+		);
+
+		[DllImport(nativeLibName, CallingConvention = CallingConvention.Cdecl)]
+		public extern static void df_frame_videoinfo(
+			IntPtr frame,
+			out int width,
+			out int height,
+			out PixelLayout pixelLayout,
+			out byte hbd
+		);
+
+		[DllImport(nativeLibName, CallingConvention = CallingConvention.Cdecl)]
+		public extern static void df_frame_timing(IntPtr frame, out FrameTiming timing);
+
 		/* Used for heap allocated string marshaling
 		 * Returned byte* must be free'd with FreeHGlobal.
 		 */
@@ -156,5 +586,113 @@ namespace Dav1dfile
 
 			return result;
 		}
+
+		public static unsafe int df_mmap_open(string fname, out IntPtr context)
+		{
+			int result;
+			if (Environment.OSVersion.Platform == PlatformID.Win32NT)
+			{
+				/* CreateFileA doesn't like UTF8 either, use LPCSTR and pray */
+				result = INTERNAL_df_mmap_open(fname, out context);
+			}
+			else
+			{
+				byte* utf8Fname = Utf8Encode(fname);
+				result = INTERNAL_df_mmap_open(utf8Fname, out context);
+				Marshal.FreeHGlobal((IntPtr) utf8Fname);
+			}
+
+			return result;
+		}
+
+		public static unsafe int df_fopen_ex(string fname, ref DecoderSettings settings, out IntPtr context)
+		{
+			int result;
+			if (Environment.OSVersion.Platform == PlatformID.Win32NT)
+			{
+				/* Windows fopen doesn't like UTF8, use LPCSTR and pray */
+				result = INTERNAL_df_fopen_ex(fname, ref settings, out context);
+			}
+			else
+			{
+				byte* utf8Fname = Utf8Encode(fname);
+				result = INTERNAL_df_fopen_ex(utf8Fname, ref settings, out context);
+				Marshal.FreeHGlobal((IntPtr) utf8Fname);
+			}
+
+			return result;
+		}
+
+		public static unsafe int df_mmap_open_ex(string fname, ref DecoderSettings settings, out IntPtr context)
+		{
+			int result;
+			if (Environment.OSVersion.Platform == PlatformID.Win32NT)
+			{
+				/* CreateFileA doesn't like UTF8 either, use LPCSTR and pray */
+				result = INTERNAL_df_mmap_open_ex(fname, ref settings, out context);
+			}
+			else
+			{
+				byte* utf8Fname = Utf8Encode(fname);
+				result = INTERNAL_df_mmap_open_ex(utf8Fname, ref settings, out context);
+				Marshal.FreeHGlobal((IntPtr) utf8Fname);
+			}
+
+			return result;
+		}
+
+		public static unsafe int df_write_index(IntPtr context, string fname)
+		{
+			int result;
+			if (Environment.OSVersion.Platform == PlatformID.Win32NT)
+			{
+				/* Windows fopen doesn't like UTF8, use LPCSTR and pray */
+				result = INTERNAL_df_write_index(context, fname);
+			}
+			else
+			{
+				byte* utf8Fname = Utf8Encode(fname);
+				result = INTERNAL_df_write_index(context, utf8Fname);
+				Marshal.FreeHGlobal((IntPtr) utf8Fname);
+			}
+
+			return result;
+		}
+
+		public static unsafe int df_load_index(IntPtr context, string fname)
+		{
+			int result;
+			if (Environment.OSVersion.Platform == PlatformID.Win32NT)
+			{
+				/* Windows fopen doesn't like UTF8, use LPCSTR and pray */
+				result = INTERNAL_df_load_index(context, fname);
+			}
+			else
+			{
+				byte* utf8Fname = Utf8Encode(fname);
+				result = INTERNAL_df_load_index(context, utf8Fname);
+				Marshal.FreeHGlobal((IntPtr) utf8Fname);
+			}
+
+			return result;
+		}
+
+		public static unsafe int df_queue_file(IntPtr context, string fname)
+		{
+			int result;
+			if (Environment.OSVersion.Platform == PlatformID.Win32NT)
+			{
+				/* Windows fopen doesn't like UTF8, use LPCSTR and pray */
+				result = INTERNAL_df_queue_file(context, fname);
+			}
+			else
+			{
+				byte* utf8Fname = Utf8Encode(fname);
+				result = INTERNAL_df_queue_file(context, utf8Fname);
+				Marshal.FreeHGlobal((IntPtr) utf8Fname);
+			}
+
+			return result;
+		}
 	}
 }
@@ -52,10 +52,89 @@ public static partial class Bindings
 		I444
 	}
 
+	public enum FrameType
+	{
+		Key,
+		Inter,
+		IntraOnly,
+		Switch
+	}
+
+	[StructLayout(LayoutKind.Sequential)]
+	public struct FrameInfo
+	{
+		public ulong offset;
+		public uint size;
+		public FrameType frameType;
+		public byte keyFrame;
+		public byte showExistingFrame;
+		public byte refreshFrameFlags;
+		public ulong presentationTime;
+	}
+
+	public enum TimingSource
+	{
+		None,
+		PictureInterval,
+		PresentationTime
+	}
+
+	[StructLayout(LayoutKind.Sequential)]
+	public struct FrameTiming
+	{
+		public uint frame;
+		public ulong presentationTime;
+		public ulong duration;
+		public double presentationSeconds;
+		public double durationSeconds;
+		public TimingSource source;
+	}
+
+	[Flags]
+	public enum InloopFilter : uint
+	{
+		None = 0,
+		Deblock = 1,
+		Cdef = 2,
+		Restoration = 4,
+		All = 7
+	}
+
+	public enum RGBAFormat
+	{
+		RGBA,
+		BGRA
+	}
+
+	public enum DecodeFrameType : uint
+	{
+		All,
+		Reference,
+		Intra,
+		Key
+	}
+
+	[StructLayout(LayoutKind.Sequential)]
+	public struct DecoderSettings
+	{
+		public int threadCount;
+		public int maxFrameDelay;
+		public int operatingPoint;
+		public byte allLayers;
+		public byte applyGrain;
+		public uint frameSizeLimit;
+		public InloopFilter inloopFilters;
+		public DecodeFrameType decodeFrameType;
+	}
+
 	[LibraryImport(nativeLibName)]
 	[UnmanagedCallConv(CallConvs = [typeof(CallConvCdecl)])]
 	public static partial uint df_linked_version();
 
+	[LibraryImport(nativeLibName)]
+	[UnmanagedCallConv(CallConvs = [typeof(CallConvCdecl)])]
+	public static partial void df_default_decoder_settings(out DecoderSettings settings);
+
 	[LibraryImport(nativeLibName)]
 	[UnmanagedCallConv(CallConvs = [typeof(CallConvCdecl)])]
 	public static partial int df_open_from_memory(
@@ -64,6 +143,23 @@ public static partial class Bindings
 		out IntPtr context
 	);
 
+	[LibraryImport(nativeLibName)]
+	[UnmanagedCallConv(CallConvs = [typeof(CallConvCdecl)])]
+	public static partial int df_open_from_memory64(
+		IntPtr bytes,
+		ulong size,
+		out IntPtr context
+	);
+
+	[LibraryImport(nativeLibName)]
+	[UnmanagedCallConv(CallConvs = [typeof(CallConvCdecl)])]
+	public static partial int df_open_ex(
+		IntPtr bytes,
+		ulong size,
+		in DecoderSettings settings,
+		out IntPtr context
+	);
+
 	[LibraryImport(nativeLibName, StringMarshalling = StringMarshalling.Utf8)]
 	[UnmanagedCallConv(CallConvs = [typeof(CallConvCdecl)])]
 	public static partial int df_fopen(
@@ -71,10 +167,115 @@ public static partial class Bindings
 		out IntPtr context
 	);
 
+	[LibraryImport(nativeLibName, StringMarshalling = StringMarshalling.Utf8)]
+	[UnmanagedCallConv(CallConvs = [typeof(CallConvCdecl)])]
+	public static partial int df_fopen_ex(
+		string filename,
+		in DecoderSettings settings,
+		out IntPtr context
+	);
+
+	[LibraryImport(nativeLibName, StringMarshalling = StringMarshalling.Utf8)]
+	[UnmanagedCallConv(CallConvs = [typeof(CallConvCdecl)])]
+	public static partial int df_mmap_open(
+		string filename,
+		out IntPtr context
+	);
+
+	[LibraryImport(nativeLibName, StringMarshalling = StringMarshalling.Utf8)]
+	[UnmanagedCallConv(CallConvs = [typeof(CallConvCdecl)])]
+	public static partial int df_mmap_open_ex(
+		string filename,
+		in DecoderSettings settings,
+		out IntPtr context
+	);
+
+	[UnmanagedFunctionPointer(CallingConvention.Cdecl)]
+	public delegate UIntPtr df_read_func(
+		IntPtr userdata,
+		IntPtr buffer,
+		UIntPtr size
+	);
+
+	[UnmanagedFunctionPointer(CallingConvention.Cdecl)]
+	public delegate int df_seek_func(
+		IntPtr userdata,
+		ulong offset
+	);
+
+	/* read and seek are function pointers, see Marshal.GetFunctionPointerForDelegate.
+	 * Keep the delegates alive until df_close!
+	 */
+	[LibraryImport(nativeLibName)]
+	[UnmanagedCallConv(CallConvs = [typeof(CallConvCdecl)])]
+	public static partial int df_open_from_callbacks(
+		IntPtr read,
+		IntPtr seek,
+		IntPtr userdata,
+		out IntPtr context
+	);
+
+	[LibraryImport(nativeLibName)]
+	[UnmanagedCallConv(CallConvs = [typeof(CallConvCdecl)])]
+	public static partial int df_open_from_callbacks_ex(
+		IntPtr read,
+		IntPtr seek,
+		IntPtr userdata,
+		in DecoderSettings settings,
+		out IntPtr context
+	);
+
 	[LibraryImport(nativeLibName)]
 	[UnmanagedCallConv(CallConvs = [typeof(CallConvCdecl)])]
 	public static partial void df_close(IntPtr context);
 
+	[StructLayout(LayoutKind.Sequential)]
+	public struct PictureBuffer
+	{
+		public int width;
+		public int height;
+		public PixelLayout pixelLayout;
+		public byte hbd;
+		public IntPtr yPlane;
+		public IntPtr uPlane;
+		public IntPtr vPlane;
+		public uint yStride;
+		public uint uvStride;
+		public IntPtr allocatorData;
+	}
+
+	[UnmanagedFunctionPointer(CallingConvention.Cdecl)]
+	public delegate int df_alloc_picture_func(
+		IntPtr userdata,
+		ref PictureBuffer buffer
+	);
+
+	[UnmanagedFunctionPointer(CallingConvention.Cdecl)]
+	public delegate void df_release_picture_func(
+		IntPtr userdata,
+		ref PictureBuffer buffer
+	);
+
+	/* alloc and release are function pointers, see Marshal.GetFunctionPointerForDelegate.
+	 * They are called from decoder threads. Keep the delegates alive until every frame is released!
+	 */
+	[LibraryImport(nativeLibName)]
+	[UnmanagedCallConv(CallConvs = [typeof(CallConvCdecl)])]
+	public static partial int df_set_picture_allocator(
+		IntPtr context,
+		IntPtr alloc,
+		IntPtr release,
+		IntPtr userdata
+	);
+
+	[LibraryImport(nativeLibName)]
+	[UnmanagedCallConv(CallConvs = [typeof(CallConvCdecl)])]
+	public static partial void df_picture_pool_stats(
+		IntPtr context,
+		out ulong hits,
+		out ulong misses
+	);
+
 	[LibraryImport(nativeLibName)]
 	[UnmanagedCallConv(CallConvs = [typeof(CallConvCdecl)])]
 	public static partial void df_videoinfo(
@@ -94,6 +295,32 @@ public static partial class Bindings
 		out byte hbd
 	);
 
+	[LibraryImport(nativeLibName)]
+	[UnmanagedCallConv(CallConvs = [typeof(CallConvCdecl)])]
+	public static partial int df_set_operating_point(IntPtr context, int operatingPoint);
+
+	[LibraryImport(nativeLibName)]
+	[UnmanagedCallConv(CallConvs = [typeof(CallConvCdecl)])]
+	public static partial int df_set_decode_quality(IntPtr context, InloopFilter inloopFilters, byte applyGrain);
+
+	[LibraryImport(nativeLibName)]
+	[UnmanagedCallConv(CallConvs = [typeof(CallConvCdecl)])]
+	public static partial void df_framesize(
+		IntPtr context,
+		out int width,
+		out int height,
+		out int renderWidth,
+		out int renderHeight
+	);
+
+	[LibraryImport(nativeLibName)]
+	[UnmanagedCallConv(CallConvs = [typeof(CallConvCdecl)])]
+	public static partial void df_set_render_crop(IntPtr context, byte enabled);
+
+	[LibraryImport(nativeLibName)]
+	[UnmanagedCallConv(CallConvs = [typeof(CallConvCdecl)])]
+	public static partial int df_frametiming(IntPtr context, out FrameTiming timing);
+
 	[LibraryImport(nativeLibName)]
 	[UnmanagedCallConv(CallConvs = [typeof(CallConvCdecl)])]
 	public static partial int df_guessframerate(
@@ -109,6 +336,63 @@ public static partial class Bindings
 	[UnmanagedCallConv(CallConvs = [typeof(CallConvCdecl)])]
 	public static partial void df_reset(IntPtr context);
 
+	[LibraryImport(nativeLibName)]
+	[UnmanagedCallConv(CallConvs = [typeof(CallConvCdecl)])]
+	public static partial void df_set_loop(IntPtr context, byte enabled);
+
+	[LibraryImport(nativeLibName)]
+	[UnmanagedCallConv(CallConvs = [typeof(CallConvCdecl)])]
+	public static partial int df_queue_memory(
+		IntPtr context,
+		IntPtr bytes,
+		ulong size
+	);
+
+	[LibraryImport(nativeLibName, StringMarshalling = StringMarshalling.Utf8)]
+	[UnmanagedCallConv(CallConvs = [typeof(CallConvCdecl)])]
+	public static partial int df_queue_file(
+		IntPtr context,
+		string filename
+	);
+
+	[LibraryImport(nativeLibName)]
+	[UnmanagedCallConv(CallConvs = [typeof(CallConvCdecl)])]
+	public static partial uint df_queue_length(IntPtr context);
+
+	[LibraryImport(nativeLibName)]
+	[UnmanagedCallConv(CallConvs = [typeof(CallConvCdecl)])]
+	public static partial int df_build_index(IntPtr context, byte background);
+
+	[LibraryImport(nativeLibName)]
+	[UnmanagedCallConv(CallConvs = [typeof(CallConvCdecl)])]
+	public static partial int df_frame_count(IntPtr context, out uint count);
+
+	[LibraryImport(nativeLibName)]
+	[UnmanagedCallConv(CallConvs = [typeof(CallConvCdecl)])]
+	public static partial int df_frame_info(
+		IntPtr context,
+		uint frame,
+		out FrameInfo info
+	);
+
+	[LibraryImport(nativeLibName)]
+	[UnmanagedCallConv(CallConvs = [typeof(CallConvCdecl)])]
+	public static partial int df_seek(IntPtr context, uint frame);
+
+	[LibraryImport(nativeLibName, StringMarshalling = StringMarshalling.Utf8)]
+	[UnmanagedCallConv(CallConvs = [typeof(CallConvCdecl)])]
+	public static partial int df_write_index(
+		IntPtr context,
+		string filename
+	);
+
+	[LibraryImport(nativeLibName, StringMarshalling = StringMarshalling.Utf8)]
+	[UnmanagedCallConv(CallConvs = [typeof(CallConvCdecl)])]
+	public static partial int df_load_index(
+		IntPtr context,
+		string filename
+	);
+
 	[LibraryImport(nativeLibName)]
 	[UnmanagedCallConv(CallConvs = [typeof(CallConvCdecl)])]
 	public static partial int df_readvideo(
@@ -122,4 +406,158 @@ public static partial class Bindings
 		out uint yStride,
 		out uint uvStride
 	);
+
+	[LibraryImport(nativeLibName)]
+	[UnmanagedCallConv(CallConvs = [typeof(CallConvCdecl)])]
+	public static partial int df_read_for_time(
+		IntPtr context,
+		double time,
+		out uint framesDropped,
+		out IntPtr yDataPtr,
+		out IntPtr uDataPtr,
+		out IntPtr vDataPtr,
+		out uint yDataLength,
+		out uint uvDataLength,
+		out uint yStride,
+		out uint uvStride
+	);
+
+	[LibraryImport(nativeLibName)]
+	[UnmanagedCallConv(CallConvs = [typeof(CallConvCdecl)])]
+	public static partial int df_pool_create(int threadCount, out IntPtr pool);
+
+	[LibraryImport(nativeLibName)]
+	[UnmanagedCallConv(CallConvs = [typeof(CallConvCdecl)])]
+	public static partial void df_pool_destroy(IntPtr pool);
+
+	[LibraryImport(nativeLibName)]
+	[UnmanagedCallConv(CallConvs = [typeof(CallConvCdecl)])]
+	public static partial int df_pool_attach(
+		IntPtr pool,
+		IntPtr context,
+		int framesAhead
+	);
+
+	[LibraryImport(nativeLibName)]
+	[UnmanagedCallConv(CallConvs = [typeof(CallConvCdecl)])]
+	public static partial int df_start_async(IntPtr context, int framesAhead);
+
+	[LibraryImport(nativeLibName)]
+	[UnmanagedCallConv(CallConvs = [typeof(CallConvCdecl)])]
+	public static partial int df_acquire_frame(
+		IntPtr context,
+		out IntPtr yDataPtr,
+		out IntPtr uDataPtr,
+		out IntPtr vDataPtr,
+		out uint yDataLength,
+		out uint uvDataLength,
+		out uint yStride,
+		out uint uvStride
+	);
+
+	[LibraryImport(nativeLibName)]
+	[UnmanagedCallConv(CallConvs = [typeof(CallConvCdecl)])]
+	public static partial void df_release_frame(IntPtr context);
+
+	[LibraryImport(nativeLibName)]
+	[UnmanagedCallConv(CallConvs = [typeof(CallConvCdecl)])]
+	public static partial int df_readvideo_rgba(
+		IntPtr context,
+		int numFrames,
+		IntPtr rgba,
+		uint stride,
+		RGBAFormat format
+	);
+
+	[LibraryImport(nativeLibName)]
+	[UnmanagedCallConv(CallConvs = [typeof(CallConvCdecl)])]
+	public static partial int df_readvideo_semiplanar(
+		IntPtr context,
+		int numFrames,
+		IntPtr yData,
+		uint yStride,
+		IntPtr uvData,
+		uint uvStride
+	);
+
+	[LibraryImport(nativeLibName)]
+	[UnmanagedCallConv(CallConvs = [typeof(CallConvCdecl)])]
+	public static partial int df_readvideo_8bit(
+		IntPtr context,
+		int numFrames,
+		IntPtr yData,
+		IntPtr uData,
+		IntPtr vData,
+		uint yStride,
+		uint uvStride,
+		byte dither
+	);
+
+	[LibraryImport(nativeLibName)]
+	[UnmanagedCallConv(CallConvs = [typeof(CallConvCdecl)])]
+	public static partial int df_readvideo_packed(
+		IntPtr context,
+		int numFrames,
+		IntPtr yData,
+		IntPtr uData,
+		IntPtr vData,
+		uint alignment,
+		out uint yDataLength,
+		out uint uvDataLength,
+		out uint yStride,
+		out uint uvStride
+	);
+
+	[LibraryImport(nativeLibName)]
+	[UnmanagedCallConv(CallConvs = [typeof(CallConvCdecl)])]
+	public static partial int df_readvideo_scaled(
+		IntPtr context,
+		int numFrames,
+		IntPtr yData,
+		IntPtr uData,
+		IntPtr vData,
+		int width,
+		int height,
+		uint yStride,
+		uint uvStride
+	);
+
+	[LibraryImport(nativeLibName)]
+	[UnmanagedCallConv(CallConvs = [typeof(CallConvCdecl)])]
+	public static partial int df_read_frame(IntPtr context, int numFrames, out IntPtr frame);
+
+	[LibraryImport(nativeLibName)]
+	[UnmanagedCallConv(CallConvs = [typeof(CallConvCdecl)])]
+	public static partial void df_frame_ref(IntPtr frame);
+
+	[LibraryImport(nativeLibName)]
+	[UnmanagedCallConv(CallConvs = [typeof(CallConvCdecl)])]
+	public static partial void df_frame_unref(IntPtr frame);
+
+	[LibraryImport(nativeLibName)]
+	[UnmanagedCallConv(CallConvs = [typeof(CallConvCdecl)])]
+	public static partial void df_frame_planes(
+		IntPtr frame,
+		out IntPtr yDataPtr,
+		out IntPtr uDataPtr,
+		out IntPtr vDataPtr,
+		out uint yDataLength,
+		out uint uvDataLength,
+		out uint yStride,
+		out uint uvStride
+	);
+
+	[LibraryImport(nativeLibName)]
+	[UnmanagedCallConv(CallConvs = [typeof(CallConvCdecl)])]
+	public static partial void df_frame_videoinfo(
+		IntPtr frame,
+		out int width,
+		out int height,
+		out PixelLayout pixelLayout,
+		out byte hbd
+	);
+
+	[LibraryImport(nativeLibName)]
+	[UnmanagedCallConv(CallConvs = [typeof(CallConvCdecl)])]
+	public static partial void df_frame_timing(IntPtr frame, out FrameTiming timing);
 }
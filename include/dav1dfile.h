@@ -64,10 +64,176 @@ typedef enum PixelLayout
 	PIXEL_LAYOUT_I444
 } PixelLayout;
 
+typedef enum FrameType
+{
+	FRAME_TYPE_KEY,
+	FRAME_TYPE_INTER,
+	FRAME_TYPE_INTRA_ONLY,
+	FRAME_TYPE_SWITCH
+} FrameType;
+
+typedef struct FrameInfo
+{
+	uint64_t offset;           /* Byte offset of the temporal unit in the bitstream */
+	uint32_t size;             /* Size of the temporal unit in bytes */
+	FrameType frameType;       /* Type of the frame that is shown */
+	uint8_t keyFrame;          /* Starts with a shown key frame, decoding can start here */
+	uint8_t showExistingFrame; /* Shows a frame decoded earlier instead of a new one */
+	uint8_t refreshFrameFlags; /* Reference slots written, 0 = no other frame depends on this one */
+	uint64_t presentationTime; /* In ticks, see FrameTiming */
+} FrameInfo;
+
+typedef enum InloopFilter
+{
+	INLOOP_FILTER_NONE = 0,
+	INLOOP_FILTER_DEBLOCK = 1,
+	INLOOP_FILTER_CDEF = 2,
+	INLOOP_FILTER_RESTORATION = 4,
+	INLOOP_FILTER_ALL = 7
+} InloopFilter;
+
+typedef enum DecodeFrameType
+{
+	DECODE_FRAME_TYPE_ALL,       /* Decode everything */
+	DECODE_FRAME_TYPE_REFERENCE, /* Only frames other frames depend on */
+	DECODE_FRAME_TYPE_INTRA,     /* Only key and intra-only frames */
+	DECODE_FRAME_TYPE_KEY        /* Only key frames */
+} DecodeFrameType;
+
+/*
+ * Decoder tuning for the _ex open functions. Start from df_default_decoder_settings,
+ * which matches what the plain open functions use.
+ *
+ * For many concurrent videos, a threadCount of 1 or 2 avoids oversubscribing the CPU.
+ * For a single video that should start and seek quickly, use threadCount 0 and a
+ * maxFrameDelay of 1. For thumbnails and scrubbing, decodeFrameType can limit
+ * decoding to key frames; frames that are not decoded are not returned either.
+ */
+typedef struct DecoderSettings
+{
+	int32_t threadCount;     /* Worker threads, 0 = one per logical core */
+	int32_t maxFrameDelay;   /* Frames decoded in parallel, 0 = automatic, 1 = lowest latency */
+	int32_t operatingPoint;  /* 0-31, for scalable streams */
+	uint8_t allLayers;       /* Output all spatial layers instead of only the highest */
+	uint8_t applyGrain;      /* Apply film grain, off by default */
+	uint32_t frameSizeLimit; /* Maximum pixels per frame, 0 = unlimited */
+	uint32_t inloopFilters;  /* InloopFilter flags, defaults to INLOOP_FILTER_ALL */
+	uint32_t decodeFrameType; /* DecodeFrameType, defaults to DECODE_FRAME_TYPE_ALL */
+} DecoderSettings;
+
+DECLSPEC void df_default_decoder_settings(DecoderSettings *settings);
+
+/*
+ * Callbacks for df_open_from_callbacks.
+ *
+ * read should copy up to size bytes into buffer and return the number of bytes
+ * copied, or 0 at the end of the stream.
+ *
+ * seek should move the read position to offset bytes from the start of the
+ * stream, returning 1 on success and 0 on failure.
+ */
+typedef size_t (*df_read_func)(void *userdata, void *buffer, size_t size);
+typedef int (*df_seek_func)(void *userdata, uint64_t offset);
+
 DECLSPEC int df_open_from_memory(uint8_t* bytes, uint32_t size, AV1_Context** context);
+
+/* Same as df_open_from_memory, for bitstreams larger than 4GB. */
+DECLSPEC int df_open_from_memory64(uint8_t* bytes, uint64_t size, AV1_Context** context);
+
+/* settings may be NULL for the defaults. */
+DECLSPEC int df_open_ex(
+	uint8_t *bytes,
+	uint64_t size,
+	const DecoderSettings *settings,
+	AV1_Context **context);
+DECLSPEC int df_fopen_ex(
+	const char *fname,
+	const DecoderSettings *settings,
+	AV1_Context **context);
 DECLSPEC int df_fopen(const char *fname, AV1_Context **context);
+
+/*
+ * Like df_fopen, but maps the file read-only instead of reading it into memory.
+ * Opening is constant-time regardless of file size, and only the pages that
+ * are actually being decoded stay resident. The mapping is released by df_close.
+ */
+DECLSPEC int df_mmap_open(const char *fname, AV1_Context **context);
+DECLSPEC int df_mmap_open_ex(
+	const char *fname,
+	const DecoderSettings *settings,
+	AV1_Context **context);
+/*
+ * Opens a stream that is pulled in through read as decoding advances, instead of
+ * requiring the whole bitstream up front. Only a bounded window of the stream is
+ * buffered (it grows only when a single OBU would not fit), so memory use does not
+ * depend on the length of the video.
+ *
+ * seek is only used by df_reset and may be NULL, in which case a stream that has
+ * already been partially consumed cannot be rewound and df_reset leaves it at the
+ * end of the stream.
+ */
+DECLSPEC int df_open_from_callbacks(
+	df_read_func read,
+	df_seek_func seek,
+	void *userdata,
+	AV1_Context **context);
+DECLSPEC int df_open_from_callbacks_ex(
+	df_read_func read,
+	df_seek_func seek,
+	void *userdata,
+	const DecoderSettings *settings,
+	AV1_Context **context);
+
 DECLSPEC void df_close(AV1_Context *context);
 
+/*
+ * Picture memory, for decoding straight into buffers the application owns.
+ *
+ * alloc gets a PictureBuffer with the picture format filled in and has to fill in
+ * the planes and strides, returning 1 on success and 0 on failure. Planes and
+ * strides must be multiples of 64 bytes, each plane must have room for its width
+ * and height rounded up to 128 pixels plus 64 bytes of padding, and the two chroma
+ * planes share a stride. allocatorData is handed back to release untouched.
+ *
+ * Both are called from decoder threads, possibly at the same time, and release
+ * can come after df_close for frames that are still referenced.
+ */
+typedef struct PictureBuffer
+{
+	int32_t width;
+	int32_t height;
+	PixelLayout pixelLayout;
+	uint8_t hbd;          /* 0 = 8 bit, 1 = 10 bit, 2 = 12 bit, samples are 16 bit if nonzero */
+
+	void *planes[3];      /* Y, U, V */
+	uint32_t strides[2];  /* Y, UV */
+	void *allocatorData;
+} PictureBuffer;
+
+typedef int (*df_alloc_picture_func)(void *userdata, PictureBuffer *buffer);
+typedef void (*df_release_picture_func)(void *userdata, const PictureBuffer *buffer);
+
+/*
+ * Has the decoder get picture memory from alloc and release. NULL functions go back
+ * to the built-in allocator. The decoder is reopened and the context is rewound
+ * to the start, so this is best done right after opening.
+ */
+DECLSPEC int df_set_picture_allocator(
+	AV1_Context *context,
+	df_alloc_picture_func alloc,
+	df_release_picture_func release,
+	void *userdata);
+
+/*
+ * The built-in allocator recycles picture memory per size and format, so once
+ * playback is going it stops allocating. Memory for sizes that are no longer
+ * decoded is freed, and df_reset frees all of it.
+ *
+ * hits counts pictures served from recycled memory, misses the ones that had to be
+ * allocated. Both stay 0 with an allocator from df_set_picture_allocator.
+ */
+DECLSPEC void df_picture_pool_stats(AV1_Context *context, uint64_t *hits, uint64_t *misses);
+
 DECLSPEC void df_videoinfo(
 	AV1_Context *context,
 	int *width,
@@ -81,6 +247,89 @@ DECLSPEC void df_videoinfo2(
 	PixelLayout *pixelLayout,
 	uint8_t *hbd);
 
+/*
+ * Selects the operating point of a scalable stream while it plays. OBUs from layers
+ * outside it are dropped before they reach the decoder, so switching to a point
+ * with fewer temporal layers cuts decoding work right away, with lower frame rates
+ * as the result: read calls return the next frame that was decoded. Switching to a
+ * point with more layers waits for the next key frame, since the frames of a layer
+ * that comes back reference frames of it that were dropped; until then playback
+ * goes on at the lower rate. Points past the stream's last one select the last.
+ * The decoder only outputs layers of the operatingPoint in DecoderSettings, so open
+ * with the point that has the most. Returns 0 if operatingPoint isn't 0-31.
+ */
+DECLSPEC int df_set_operating_point(AV1_Context *context, int32_t operatingPoint);
+
+/*
+ * Changes decode quality while playing, e.g. INLOOP_FILTER_NONE for a cheap preview
+ * and INLOOP_FILTER_ALL once the video is in the foreground. dav1d only takes the
+ * filters when it is created, so changing them swaps in a new decoder that picks
+ * up at the key frame before the next frame to be read; the frames in between are
+ * decoded but not returned. That needs the index, so it fails for streams opened
+ * with df_open_from_callbacks. If picking up there fails, the context goes back
+ * to the start of the video and this returns 0. Film grain is added to frames as
+ * they come out of the decoder and switches without a restart. That is serial work
+ * on the thread decoding, the reading thread unless decoding is async, instead of
+ * dav1d's own threads. Both start out as DecoderSettings says.
+ */
+DECLSPEC int df_set_decode_quality(AV1_Context *context, uint32_t inloopFilters, uint8_t applyGrain);
+
+/*
+ * df_videoinfo reports the largest size the sequence header allows. Frames can be
+ * smaller when the stream switches resolution, and the render size says how much
+ * of a frame is meant to be shown. df_framesize reports both for the frame the
+ * last read returned, or the df_videoinfo size before the first read.
+ */
+DECLSPEC void df_framesize(
+	AV1_Context *context,
+	int *width,
+	int *height,
+	int *renderWidth,
+	int *renderHeight);
+
+/*
+ * With crop enabled, the output functions that copy or convert frames (RGBA,
+ * semi-planar, 8-bit, packed, scaled) only emit the top left render rectangle of
+ * each frame, when the render size is smaller than the frame. df_readvideo still
+ * returns the whole planes. Off by default.
+ */
+DECLSPEC void df_set_render_crop(AV1_Context *context, uint8_t enabled);
+
+/*
+ * When a frame is meant to be shown, from the timing info in the sequence header.
+ * Times are in ticks of num_units_in_tick / time_scale seconds, counted from the
+ * first frame of the stream, and also given in seconds. Streams with a fixed
+ * picture interval advance by it every frame. Otherwise the frame headers can
+ * carry presentation times, which wrap around and restart at key frames; they are
+ * unwrapped into one running clock, and a restart advances it by the interval
+ * before it.
+ *
+ * Without either, ticks count frames and the seconds are 0. The duration is the
+ * time until the next frame. For presentation times that comes from the index
+ * when it is ready, otherwise it repeats the interval before the frame.
+ *
+ * df_frametiming reports the frame the last read returned, and returns 0 before
+ * the first read.
+ */
+typedef enum TimingSource
+{
+	TIMING_SOURCE_NONE,              /* Ticks count frames */
+	TIMING_SOURCE_PICTURE_INTERVAL,  /* Fixed interval from the sequence header */
+	TIMING_SOURCE_PRESENTATION_TIME  /* frame_presentation_time in the frame headers */
+} TimingSource;
+
+typedef struct FrameTiming
+{
+	uint32_t frame;              /* Temporal unit number, what df_seek takes */
+	uint64_t presentationTime;   /* In ticks */
+	uint64_t duration;           /* In ticks */
+	double presentationSeconds;
+	double durationSeconds;
+	TimingSource source;
+} FrameTiming;
+
+DECLSPEC int df_frametiming(AV1_Context *context, FrameTiming *timing);
+
 /*
  * This will attempt to guess the framerate from timing data in the sequence header.
  * If it is present, it will set the fps value and return 1.
@@ -97,6 +346,78 @@ DECLSPEC int df_guessframerate(AV1_Context *context, double *fps);
 DECLSPEC int df_eos(AV1_Context *context);
 DECLSPEC void df_reset(AV1_Context *context);
 
+/*
+ * For looping playback without the stall of a df_reset at every loop point. With
+ * loop on, the start of the stream is fed to the decoder right after its end,
+ * without a flush, so the first frames of the next pass are decoding while the last
+ * ones play, and df_eos stays 0. Frame numbers and presentation times keep counting
+ * up from pass to pass; df_frame_info and df_seek take frame numbers of the first
+ * pass. Turn it on before the end of the stream is reached; turned off, the pass
+ * being fed plays to its end. Off by default.
+ */
+DECLSPEC void df_set_loop(AV1_Context *context, uint8_t enabled);
+
+/*
+ * Gapless playlists. Queued bitstreams play after the one the context was opened
+ * with, in order, without a gap: the next one is fed to the decoder as soon as the
+ * one before it runs out, and its sequence header is read when it is queued. When
+ * the pixel layout, bit depth and operating points match, the same decoder goes on
+ * without a flush; otherwise the frames of the one before drain first and a new
+ * decoder takes over.
+ *
+ * Frame numbers and presentation times keep counting up across sources. The rest
+ * of the API is about the source playing: df_videoinfo, the index, and the frame
+ * numbers df_frame_info and df_seek take, which count from its start. df_reset goes
+ * back to its start. A source is freed once its last frame has been read. With loop
+ * on, the last source loops.
+ *
+ * df_queue_memory keeps a pointer to bytes, which must stay valid until the source
+ * has played or the context is closed. df_queue_file maps the file, which is paged
+ * in as the feed gets to it; where there is no mapping support it is read in
+ * whole. Queueing fails for df_open_from_callbacks contexts and for bitstreams
+ * without a usable sequence header. Queue from the thread that reads frames.
+ *
+ * df_queue_length is the number of sources after the one playing.
+ */
+DECLSPEC int df_queue_memory(AV1_Context *context, uint8_t *bytes, uint64_t size);
+DECLSPEC int df_queue_file(AV1_Context *context, const char *fname);
+DECLSPEC uint32_t df_queue_length(AV1_Context *context);
+
+/*
+ * Builds an index of the temporal units in the bitstream, one per shown frame,
+ * in a single pass over the headers. With background set, the pass runs on its
+ * own thread and this returns right away.
+ *
+ * df_frame_count and df_frame_info build the index on first use, or wait for
+ * a background build to finish. Not available for df_open_from_callbacks contexts.
+ */
+DECLSPEC int df_build_index(AV1_Context *context, uint8_t background);
+DECLSPEC int df_frame_count(AV1_Context *context, uint32_t *count);
+DECLSPEC int df_frame_info(AV1_Context *context, uint32_t frame, FrameInfo *info);
+
+/*
+ * Saves the index (building it if needed) to a sidecar file, so later opens can skip
+ * scanning the bitstream. df_fopen and df_mmap_open look for "<fname>.dfidx" next to
+ * the video and use it if it matches the file's size and a hash of its first and
+ * last 64KB, so these can be generated at build time for shipped content.
+ * df_load_index does the same for contexts opened from memory.
+ */
+DECLSPEC int df_write_index(AV1_Context *context, const char *fname);
+DECLSPEC int df_load_index(AV1_Context *context, const char *fname);
+
+/*
+ * Moves to the given frame of the index. Decoding restarts at the closest key
+ * frame at or before it, and the frames in between are decoded but not returned,
+ * or not decoded at all if no other frame references them, so the cost is bounded
+ * by the distance between key frames rather than the position in the file. The
+ * next df_readvideo returns the requested frame.
+ */
+DECLSPEC int df_seek(AV1_Context *context, uint32_t frame);
+
+/*
+ * Returns the numFrames-th next frame. The frames before it are skipped the same
+ * way df_seek skips them, so catching up after a hitch costs less than playing.
+ */
 DECLSPEC int df_readvideo(
 	AV1_Context *context,
 	int numFrames,
@@ -108,6 +429,216 @@ DECLSPEC int df_readvideo(
 	uint32_t *yStride,
 	uint32_t *uvStride);
 
+/*
+ * Reads the frame that should be on screen time seconds into the stream, going by
+ * the presentation times df_frametiming reports. The frames before it are skipped
+ * like df_readvideo skips them, or by seeking when a key frame comes first, and
+ * framesDropped says how many frames since the last read were never returned.
+ *
+ * Returns 1 with a new frame, 0 when there is none: either the frame from the
+ * last read is still the one to show, or the stream ended, which df_eos tells
+ * apart. Returns -1 on failure, including for streams without timing info. Time
+ * going backwards needs a df_seek. The index is built on first use;
+ * df_open_from_callbacks contexts do without, and there frame presentation times
+ * are estimated from the interval before the current frame.
+ */
+DECLSPEC int df_read_for_time(
+	AV1_Context *context,
+	double time,
+	uint32_t *framesDropped,
+	void **yData,
+	void **uData,
+	void **vData,
+	uint32_t *yDataLength,
+	uint32_t *uvDataLength,
+	uint32_t *yStride,
+	uint32_t *uvStride);
+
+/*
+ * A fixed set of decode threads shared by any number of contexts.
+ *
+ * Every attached context decodes up to framesAhead frames ahead of its reader,
+ * one frame per turn in round-robin order, so total CPU use is capped by the
+ * pool's threadCount no matter how many videos are open, and a context whose
+ * reader is not keeping up costs nothing. df_readvideo only waits when the
+ * next frame is not ready yet.
+ *
+ * threadCount 0 means one thread per logical core.
+ */
+typedef struct AV1_Pool AV1_Pool;
+
+DECLSPEC int df_pool_create(int32_t threadCount, AV1_Pool **pool);
+
+/* Close the attached contexts first. */
+DECLSPEC void df_pool_destroy(AV1_Pool *pool);
+
+/*
+ * Hands the context's decoding over to the pool until df_close.
+ * The decoder is reopened single-threaded and the context is rewound to the start.
+ * framesAhead 0 means the default of 2.
+ */
+DECLSPEC int df_pool_attach(AV1_Pool *pool, AV1_Context *context, int32_t framesAhead);
+
+/*
+ * Starts decoding up to framesAhead frames ahead on a background thread of the
+ * context's own, from the current position and with the context's decoder settings.
+ * framesAhead 0 means the default of 2. The thread is stopped by df_close.
+ */
+DECLSPEC int df_start_async(AV1_Context *context, int32_t framesAhead);
+
+/*
+ * For contexts running with df_start_async or df_pool_attach.
+ *
+ * Hands out the oldest decoded frame without waiting for the decoder. Returns 0 if
+ * no frame is ready yet, check df_eos to tell that apart from the end of the stream,
+ * and -1 once decoding failed.
+ * Several frames can be acquired at once, the planes stay valid until the frame is
+ * given back with df_release_frame, which always releases the oldest acquired frame.
+ *
+ * Frames still acquired keep the decoder from running more than framesAhead frames
+ * ahead, are dropped by df_reset and df_close, and make df_readvideo fail.
+ */
+DECLSPEC int df_acquire_frame(
+	AV1_Context *context,
+	void **yData,
+	void **uData,
+	void **vData,
+	uint32_t *yDataLength,
+	uint32_t *uvDataLength,
+	uint32_t *yStride,
+	uint32_t *uvStride);
+DECLSPEC void df_release_frame(AV1_Context *context);
+
+/*
+ * Reads like df_readvideo, then converts the frame to 8-bit RGBA or BGRA with alpha
+ * 255 into rgba, which needs stride bytes for each row of the frame, and stride has
+ * to be at least 4 * width. The sequence header's matrix coefficients, color range
+ * and chroma sample position are taken into account. Large frames are converted on
+ * several threads, one set of them shared by all contexts, at most one per core.
+ */
+typedef enum RGBAFormat
+{
+	RGBA_FORMAT_RGBA,
+	RGBA_FORMAT_BGRA
+} RGBAFormat;
+
+DECLSPEC int df_readvideo_rgba(
+	AV1_Context *context,
+	int numFrames,
+	uint8_t *rgba,
+	uint32_t stride,
+	RGBAFormat format);
+
+/*
+ * Reads like df_readvideo, then copies the frame into two planes with U and V
+ * interleaved, ready for a two plane texture: NV12 for 8-bit 4:2:0 and P010/P016
+ * for high bit depth, where samples sit in the top bits of 16 bit words. 4:2:2 and
+ * 4:4:4 keep their chroma size (NV16, NV24) and monochrome frames get neutral 4:2:0
+ * chroma. Strides are in bytes; uvStride covers both chroma samples of a row.
+ */
+DECLSPEC int df_readvideo_semiplanar(
+	AV1_Context *context,
+	int numFrames,
+	void *yData,
+	uint32_t yStride,
+	void *uvData,
+	uint32_t uvStride);
+
+/*
+ * Reads like df_readvideo, then copies the frame into 8-bit planes. High bit depth
+ * samples are rounded down to 8 bits, or with dither set, spread with an ordered
+ * dither to hide banding. 8-bit frames are copied as they are and monochrome frames
+ * get neutral 4:2:0 chroma. Strides are in bytes.
+ */
+DECLSPEC int df_readvideo_8bit(
+	AV1_Context *context,
+	int numFrames,
+	void *yData,
+	void *uData,
+	void *vData,
+	uint32_t yStride,
+	uint32_t uvStride,
+	uint8_t dither);
+
+/*
+ * Reads like df_readvideo, then copies only the visible samples of each plane into
+ * yData, uData and vData, with each row padded to a multiple of alignment bytes
+ * (a power of two, 0 or 1 packs rows tightly). Stride and length outputs describe
+ * the copies: lengths are stride * rows, without the padding rows df_readvideo
+ * reports. Monochrome frames have no chroma, uData and vData may be NULL and the
+ * chroma outputs are 0. Each plane needs its padded stride times its rows: for Y,
+ * the width times the bytes per sample, rounded up to alignment, times the height.
+ * Chroma is the same with the chroma width and height, halved for subsampled
+ * layouts and rounded up.
+ * Large frames are written with streaming stores that skip the cache.
+ */
+DECLSPEC int df_readvideo_packed(
+	AV1_Context *context,
+	int numFrames,
+	void *yData,
+	void *uData,
+	void *vData,
+	uint32_t alignment,
+	uint32_t *yDataLength,
+	uint32_t *uvDataLength,
+	uint32_t *yStride,
+	uint32_t *uvStride);
+
+/*
+ * Reads like df_readvideo, then copies the frame shrunk to width x height into
+ * yData, uData and vData, for thumbnails and previews. Each output sample is the
+ * average of the block it covers; halving each side has a fast path. The size can't
+ * be larger than the frame, chroma keeps the frame's subsampling at the new size
+ * and samples keep its bit depth. Monochrome frames get neutral 4:2:0 chroma.
+ * Strides are in bytes.
+ */
+DECLSPEC int df_readvideo_scaled(
+	AV1_Context *context,
+	int numFrames,
+	void *yData,
+	void *uData,
+	void *vData,
+	int width,
+	int height,
+	uint32_t yStride,
+	uint32_t uvStride);
+
+/*
+ * Reference counted frames, for holding on to several frames without copying them.
+ *
+ * df_read_frame works like df_readvideo but hands out a new frame with one reference
+ * instead of reusing the planes of the previous call. The planes stay valid until
+ * the last reference is dropped with df_frame_unref, even after df_close, so frames
+ * can sit in an upload queue while decoding goes on. df_frame_ref and df_frame_unref
+ * may be called from any thread.
+ */
+typedef struct AV1_Frame AV1_Frame;
+
+DECLSPEC int df_read_frame(AV1_Context *context, int numFrames, AV1_Frame **frame);
+DECLSPEC void df_frame_ref(AV1_Frame *frame);
+DECLSPEC void df_frame_unref(AV1_Frame *frame);
+
+DECLSPEC void df_frame_planes(
+	AV1_Frame *frame,
+	void **yData,
+	void **uData,
+	void **vData,
+	uint32_t *yDataLength,
+	uint32_t *uvDataLength,
+	uint32_t *yStride,
+	uint32_t *uvStride);
+
+/* Same as df_videoinfo2, for this frame */
+DECLSPEC void df_frame_videoinfo(
+	AV1_Frame *frame,
+	int *width,
+	int *height,
+	PixelLayout *pixelLayout,
+	uint8_t *hbd);
+
+/* Same as df_frametiming, for this frame */
+DECLSPEC void df_frame_timing(AV1_Frame *frame, FrameTiming *timing);
+
 #ifdef __cplusplus
 }
 #endif /* __cplusplus */
@@ -24,27 +24,354 @@
  *
  */
 
+/* 64-bit ftello/fseeko and off_t on 32-bit POSIX targets */
+#define _FILE_OFFSET_BITS 64
+
 #include "dav1dfile.h"
 #include "obuparse.h"
+#include "dav1dfile_convert.h"
 
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
 
 #ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
 #define inline __inline
+#else
+#include <pthread.h>
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#define DF_HAVE_MMAP
+#endif
+#endif /* _WIN32 */
+
+/* Consumed pages of a mapped file are handed back to the OS in chunks of this
+ * size, trailing the read position by one chunk so that packets still queued
+ * inside dav1d don't immediately fault back in.
+ */
+#define MMAP_RELEASE_CHUNK (8 * 1024 * 1024)
+
+/* Initial size of the input buffer used by df_open_from_callbacks.
+ * It only grows past this if a single OBU does not fit.
+ */
+#define STREAM_BUFFER_SIZE (1024 * 1024)
+
+/* OBU header (2 bytes) plus the largest leb128 size field (8 bytes) */
+#define MAX_OBU_HEADER_SIZE 10
+
+/* Sidecar index files, see df_write_index. All fields are little-endian. */
+#define INDEX_FILE_EXTENSION ".dfidx"
+#define INDEX_FILE_VERSION 2
+#define INDEX_FILE_HEADER_SIZE 72
+#define INDEX_FILE_ENTRY_SIZE 24
+#define INDEX_HASH_CHUNK (64 * 1024) /* bytes hashed at each end of the bitstream */
+
+/* Frames a pooled context decodes ahead of the reader by default */
+#define DEFAULT_FRAMES_AHEAD 2
+#define MAX_FRAMES_AHEAD 64
+
+/* dav1d decodes on the calling thread when n_threads is 1, and it needs
+ * more stack than some platforms give secondary threads by default.
+ */
+#define POOL_THREAD_STACK_SIZE (2 * 1024 * 1024)
+
+/* RGBA conversion is split into bands of rows for the conversion threads,
+ * once pictures are big enough for that to pay off
+ */
+#define CONVERT_BAND_ROWS 64
+#define CONVERT_PARALLEL_PIXELS (1920 * 1080)
+#define CONVERT_MAX_THREADS 8
+
+/* Recycled pictures of a size nothing asked for in this many allocations are freed */
+#define PICTURE_IDLE_ALLOCATIONS 32
+
+#ifdef _WIN32
+typedef HANDLE Thread;
+typedef SRWLOCK Mutex;
+typedef CONDITION_VARIABLE Condition;
+#define THREAD_RETURN DWORD WINAPI
+#define MUTEX_INITIALIZER SRWLOCK_INIT
+#else
+typedef pthread_t Thread;
+typedef pthread_mutex_t Mutex;
+typedef pthread_cond_t Condition;
+#define THREAD_RETURN void*
+#define MUTEX_INITIALIZER PTHREAD_MUTEX_INITIALIZER
 #endif /* _WIN32 */
 
-typedef struct Context {
+typedef struct Context Context;
+
+typedef enum IndexState
+{
+	INDEX_STATE_NONE,
+	INDEX_STATE_BUILDING,
+	INDEX_STATE_READY,
+	INDEX_STATE_FAILED
+} IndexState;
+
+/* Contents of a sidecar index file */
+typedef struct IndexFile
+{
+	uint64_t bitstreamSize;
+	uint64_t bitstreamHash;
+
+	int32_t width;
+	int32_t height;
+	uint8_t pixelLayout;
+	uint8_t hbd;
+	uint8_t timing_info_present;
+	uint8_t equal_picture_interval;
+	uint32_t num_units_in_tick;
+	uint32_t time_scale;
+	uint32_t num_ticks_per_picture;
+	uint64_t sequenceHeaderOffset;
+	uint64_t sequenceHeaderSize;
+
+	FrameInfo *entries;
+	uint32_t count;
+} IndexFile;
+
+/* Frame header parsing needs the sequence header and the reference state */
+typedef struct HeaderParser
+{
+	OBPSequenceHeader sequenceHeader;
+	OBPState state;
+	uint8_t hasSequenceHeader;
+} HeaderParser;
+
+/* Presentation time of the temporal units, in ticks. The feed and the index
+ * keep one each, so they agree on every frame.
+ */
+typedef struct PresentationClock
+{
+	uint64_t time;             /* of the last temporal unit */
+	uint64_t interval;         /* between the last two */
+	uint32_t presentationTime; /* last frame_presentation_time, for unwrapping */
+	uint8_t started;
+} PresentationClock;
+
+/* A bitstream queued to play after the one before it, see df_queue_memory */
+typedef struct Source
+{
+	struct Source *next;
+	uint8_t *bitstreamData;
+	size_t bitstreamDataSize;
+	uint8_t ownsBitstream;
+	uint8_t mapped;
+	size_t sequenceHeaderOffset;
+	size_t sequenceHeaderSize;
+	Dav1dSequenceHeader sequenceHeader;
+	uint8_t compatible; /* can follow the source before it on the same decoder */
+
+	/* Set by the feed when it gets here */
+	uint8_t started;
+	uint32_t firstFrame;
+	uint64_t firstTime;
+} Source;
+
+typedef struct OBUInfo
+{
+	OBPOBUType type;
+	size_t size; /* header included */
+	uint8_t hasExtension; /* without one, the IDs are 0 and mean nothing */
+	int temporalID;
+	int spatialID;
+	uint8_t hasFrameHeader;
+	OBPFrameHeader frameHeader;
+} OBUInfo;
+
+/* Recycled picture memory, one bucket per picture format */
+typedef struct PictureBucket PictureBucket;
+
+typedef struct PictureBlock
+{
+	struct PictureBlock *next;
+	PictureBucket *bucket;
+} PictureBlock;
+
+struct PictureBucket
+{
+	PictureBucket *next;
+	int32_t width;
+	int32_t height;
+	int32_t layout;
+	int32_t bpc;
+	PictureBlock *freeBlocks;
+	uint32_t usedBlocks;
+	uint64_t lastUse; /* allocation count when this format was last asked for */
+};
+
+/* Picture memory for dav1d. Either the application's, see df_set_picture_allocator,
+ * or recycled through the buckets so steady playback doesn't allocate at all.
+ */
+typedef struct Allocator
+{
+	df_alloc_picture_func alloc; /* NULL for recycling */
+	df_release_picture_func release;
+	void *userdata;
+
+	Mutex lock;
+	PictureBucket *buckets;
+	uint64_t allocations;
+	uint64_t hits;
+	uint64_t misses;
+
+	volatile uint32_t refCount; /* the context, plus every picture allocated */
+} Allocator;
+
+/* Threads that convert bands of rows for the caller, see df_readvideo_rgba */
+/* A picture being converted. It lives on the stack of the thread converting it,
+ * which waits for every band to be done, so whoever holds a band can read it.
+ */
+typedef struct ConvertJob
+{
+	struct ConvertJob *next;
+	const RGBAConversion *conversion;
+	df_rgba_row_func rowFunc;
+	Dav1dPicture picture; /* a copy, the caller's may be a cropped view on its stack */
+	uint8_t *rgba;
+	uint32_t stride;
+	int32_t width;
+	int32_t height;
+	int32_t bandCount;
+	int32_t nextBand;
+	int32_t bandsLeft;
+	uint8_t failed;
+} ConvertJob;
+
+/* Conversion threads, one set for all contexts so they stay within the core count */
+typedef struct Converter
+{
+	Mutex lock;
+	Condition workReady;
+	Condition workDone;
+	Thread *threads;
+	int32_t threadCount;
+	uint8_t shutdown;
+	uint32_t users; /* guarded by converterLock */
+
+	ConvertJob *jobs; /* with bands left to hand out, oldest first */
+} Converter;
+
+/* A decoded picture handed out to the application, see df_read_frame */
+typedef struct Frame
+{
+	Dav1dPicture picture;
+	FrameTiming timing;
+	volatile uint32_t refCount;
+} Frame;
+
+typedef struct Pool {
+	Mutex lock;
+	Condition workReady;  /* a context became runnable, or the pool is shutting down */
+	Condition frameReady; /* a frame was queued, or a worker let go of a context */
+
+	Thread *threads;
+	int32_t threadCount;
+
+	Context *contexts;
+	Context *cursor; /* last context served, for round-robin */
+	uint8_t shutdown;
+} Pool;
+
+struct Context {
 	Dav1dContext *dav1dContext;
 
 	uint8_t *bitstreamData;
-	uint32_t bitstreamDataSize;
+	size_t bitstreamDataSize;
 	size_t bitstreamIndex;
 	size_t currentOBUSize;
 
+	/* Set when bitstreamData was allocated or mapped by us */
+	uint8_t ownsBitstream;
+	uint8_t mapped;
+	size_t releasedIndex;
+
+	/* Streaming input, bitstreamData is a sliding window over the stream */
+	df_read_func readFunc;
+	df_seek_func seekFunc;
+	void *userdata;
+	size_t streamBufferCapacity;
+	uint64_t streamOffset; /* stream position of bitstreamData[0] */
+	uint8_t streamEnd;
+	uint8_t streamPinned; /* don't discard consumed data while scanning */
+
+	DecoderSettings settings;
+	Allocator *allocator;
+	volatile uint32_t applyGrain; /* dav1d never adds grain, it's added as pictures come out */
+
+	/* Packet that dav1d did not accept yet */
+	Dav1dData pendingData;
+
+	/* Where the first sequence header is, dav1d forgets it when flushed */
+	size_t sequenceHeaderOffset;
+	size_t sequenceHeaderSize;
+
+	/* Temporal units are numbered as they are fed to dav1d, the number rides
+	 * along as the data timestamp. Frames before skipToFrame are not shown,
+	 * and the ones nothing references are not even sent.
+	 */
+	HeaderParser *feedParser;
+	OBUInfo *feedInfo;
+	uint32_t feedFrame;
+	uint8_t feedShown;
+	uint8_t feedHasTemporalDelimiters;
+	uint8_t feedDropping; /* tile groups of a dropped frame follow */
+	PresentationClock feedClock;
+	volatile uint32_t operatingPoint; /* the one asked for */
+	uint32_t feedOperatingPoint; /* layers outside it are not sent */
+	volatile uint32_t skipToFrame;
+	volatile uint32_t loop; /* the end of the stream is fed as if the start followed */
+	uint32_t nextFrame; /* what df_readvideo returns next */
+
+	/* Playlist. The reader is in playing, the feed in feeding or a later source,
+	 * whose bitstream it works on in the fields above. Without a queue both are
+	 * NULL. Links and the feed's marks on sources are guarded by sourceLock.
+	 */
+	Mutex sourceLock;
+	Source *playing;
+	Source *feeding;
+	uint32_t frameBase; /* the playing source's first frame and its time */
+	uint64_t timeBase;
+
+	/* Output conversion */
+	uint8_t renderCrop;
+	Converter *converter;
+	df_rgba_row_func rgbaRowFunc;
+	uint16_t *convertScratch;
+	int32_t convertScratchWidth;
+
+	/* Pooled decoding. Only the worker holding decodeBusy touches the decoder,
+	 * and it is the only producer for frameQueue, a single-producer,
+	 * single-consumer ring the reader drains without taking pool->lock.
+	 * The rest is guarded by pool->lock.
+	 */
+	Pool *pool;
+	Context *poolNext;
+	uint8_t ownsPool; /* private pool from df_start_async */
+	Dav1dPicture *frameQueue;
+	uint32_t frameQueueCapacity;
+	volatile uint32_t frameWriteIndex;   /* frames decoded */
+	volatile uint32_t frameReleaseIndex; /* frames the reader is done with */
+	uint32_t frameAcquireIndex;          /* frames handed to the reader */
+	int decodeResult; /* 1 while decoding, then 0 at the end of the stream or -1 on error */
+	uint8_t decodeBusy;
+	uint8_t decodePaused;
+
 	Dav1dPicture currentPicture;
 
+	/* Temporal unit index, one entry per shown frame */
+	FrameInfo *index;
+	uint32_t indexCount;
+	IndexState indexState;
+	Thread indexThread;
+	uint8_t indexThreadRunning;
+
 	int32_t width;
 	int32_t height;
 	PixelLayout pixelLayout;
@@ -58,7 +385,164 @@ typedef struct Context {
 	uint32_t num_ticks_per_picture;
 
 	uint8_t eof;
-} Context;
+};
+
+/* Threads */
+
+static void INTERNAL_mutexInit(Mutex *mutex)
+{
+#ifdef _WIN32
+	InitializeSRWLock(mutex);
+#else
+	pthread_mutex_init(mutex, NULL);
+#endif
+}
+
+static void INTERNAL_mutexDestroy(Mutex *mutex)
+{
+#ifndef _WIN32
+	pthread_mutex_destroy(mutex);
+#endif
+}
+
+static inline void INTERNAL_mutexLock(Mutex *mutex)
+{
+#ifdef _WIN32
+	AcquireSRWLockExclusive(mutex);
+#else
+	pthread_mutex_lock(mutex);
+#endif
+}
+
+static inline void INTERNAL_mutexUnlock(Mutex *mutex)
+{
+#ifdef _WIN32
+	ReleaseSRWLockExclusive(mutex);
+#else
+	pthread_mutex_unlock(mutex);
+#endif
+}
+
+static void INTERNAL_conditionInit(Condition *condition)
+{
+#ifdef _WIN32
+	InitializeConditionVariable(condition);
+#else
+	pthread_cond_init(condition, NULL);
+#endif
+}
+
+static void INTERNAL_conditionDestroy(Condition *condition)
+{
+#ifndef _WIN32
+	pthread_cond_destroy(condition);
+#endif
+}
+
+static inline void INTERNAL_conditionWait(Condition *condition, Mutex *mutex)
+{
+#ifdef _WIN32
+	SleepConditionVariableSRW(condition, mutex, INFINITE, 0);
+#else
+	pthread_cond_wait(condition, mutex);
+#endif
+}
+
+static inline void INTERNAL_conditionSignal(Condition *condition)
+{
+#ifdef _WIN32
+	WakeConditionVariable(condition);
+#else
+	pthread_cond_signal(condition);
+#endif
+}
+
+static inline void INTERNAL_conditionBroadcast(Condition *condition)
+{
+#ifdef _WIN32
+	WakeAllConditionVariable(condition);
+#else
+	pthread_cond_broadcast(condition);
+#endif
+}
+
+static int INTERNAL_threadCreate(Thread *thread, THREAD_RETURN (*func)(void*), void *data)
+{
+#ifdef _WIN32
+	*thread = CreateThread(NULL, POOL_THREAD_STACK_SIZE, func, data, 0, NULL);
+	return *thread != NULL;
+#else
+	pthread_attr_t attr;
+	int result;
+
+	pthread_attr_init(&attr);
+	pthread_attr_setstacksize(&attr, POOL_THREAD_STACK_SIZE);
+	result = pthread_create(thread, &attr, func, data);
+	pthread_attr_destroy(&attr);
+
+	return result == 0;
+#endif
+}
+
+static void INTERNAL_threadJoin(Thread thread)
+{
+#ifdef _WIN32
+	WaitForSingleObject(thread, INFINITE);
+	CloseHandle(thread);
+#else
+	pthread_join(thread, NULL);
+#endif
+}
+
+static int32_t INTERNAL_cpuCount(void)
+{
+#if defined(_WIN32)
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	return (int32_t) info.dwNumberOfProcessors;
+#elif defined(_SC_NPROCESSORS_ONLN)
+	long count = sysconf(_SC_NPROCESSORS_ONLN);
+	return count > 0 ? (int32_t) count : 1;
+#else
+	return 1;
+#endif
+}
+
+static inline uint32_t INTERNAL_atomicLoad(volatile uint32_t *value)
+{
+#ifdef _MSC_VER
+	return (uint32_t) InterlockedCompareExchange((volatile LONG*) value, 0, 0);
+#else
+	return __atomic_load_n(value, __ATOMIC_SEQ_CST);
+#endif
+}
+
+static inline void INTERNAL_atomicStore(volatile uint32_t *value, uint32_t newValue)
+{
+#ifdef _MSC_VER
+	InterlockedExchange((volatile LONG*) value, (LONG) newValue);
+#else
+	__atomic_store_n(value, newValue, __ATOMIC_SEQ_CST);
+#endif
+}
+
+static inline uint32_t INTERNAL_atomicIncrement(volatile uint32_t *value)
+{
+#ifdef _MSC_VER
+	return (uint32_t) InterlockedIncrement((volatile LONG*) value);
+#else
+	return __atomic_add_fetch(value, 1, __ATOMIC_SEQ_CST);
+#endif
+}
+
+static inline uint32_t INTERNAL_atomicDecrement(volatile uint32_t *value)
+{
+#ifdef _MSC_VER
+	return (uint32_t) InterlockedDecrement((volatile LONG*) value);
+#else
+	return __atomic_sub_fetch(value, 1, __ATOMIC_SEQ_CST);
+#endif
+}
 
 static void allocator_no_op(const uint8_t *data, void *opaque)
 {
@@ -70,6 +554,137 @@ uint32_t df_linked_version(void)
 	return DAV1DFILE_COMPILED_VERSION;
 }
 
+/* Returns the full size of the OBU at buf (header included),
+ * or 0 if more bytes are needed to tell.
+ */
+static size_t INTERNAL_peekOBUSize(const uint8_t *buf, size_t size)
+{
+	size_t pos = 1;
+	uint64_t value = 0;
+	int i;
+
+	if (size < 1)
+	{
+		return 0;
+	}
+
+	if (buf[0] & 0x04) /* obu_extension_flag */
+	{
+		pos += 1;
+	}
+
+	if (!(buf[0] & 0x02)) /* !obu_has_size_field, OBU runs to the end of the stream */
+	{
+		return SIZE_MAX;
+	}
+
+	for (i = 0; i < 8; i += 1)
+	{
+		if (pos >= size)
+		{
+			return 0;
+		}
+
+		value |= (uint64_t) (buf[pos] & 0x7F) << (i * 7);
+		pos += 1;
+
+		if (!(buf[pos - 1] & 0x80))
+		{
+			break;
+		}
+	}
+
+	if (value > SIZE_MAX - pos)
+	{
+		return SIZE_MAX;
+	}
+
+	return pos + (size_t) value;
+}
+
+static int INTERNAL_readStream(Context *context, size_t needed)
+{
+	size_t remaining, capacity, read;
+	uint8_t *buffer;
+
+	while (!context->streamEnd && context->bitstreamDataSize - context->bitstreamIndex < needed)
+	{
+		/* Slide consumed data out of the window */
+		if (!context->streamPinned && context->bitstreamIndex > 0)
+		{
+			remaining = context->bitstreamDataSize - context->bitstreamIndex;
+			memmove(
+				context->bitstreamData,
+				context->bitstreamData + context->bitstreamIndex,
+				remaining
+			);
+			context->streamOffset += context->bitstreamIndex;
+			context->bitstreamDataSize = remaining;
+			context->bitstreamIndex = 0;
+		}
+
+		/* Only grow if there is no room left to read into */
+		capacity = context->streamBufferCapacity;
+		if (context->bitstreamData != NULL && context->bitstreamDataSize == capacity)
+		{
+			if (capacity > SIZE_MAX / 2)
+			{
+				return 0;
+			}
+			capacity *= 2;
+		}
+
+		if (capacity != context->streamBufferCapacity || context->bitstreamData == NULL)
+		{
+			buffer = realloc(context->bitstreamData, capacity);
+			if (!buffer)
+			{
+				return 0;
+			}
+			context->bitstreamData = buffer;
+			context->streamBufferCapacity = capacity;
+		}
+
+		read = context->readFunc(
+			context->userdata,
+			context->bitstreamData + context->bitstreamDataSize,
+			context->streamBufferCapacity - context->bitstreamDataSize
+		);
+
+		if (read == 0)
+		{
+			context->streamEnd = 1;
+		}
+		context->bitstreamDataSize += read;
+	}
+
+	return 1;
+}
+
+/* Makes sure the next OBU is entirely inside the window */
+static int INTERNAL_fillStream(Context *context)
+{
+	size_t obuSize;
+
+	if (!INTERNAL_readStream(context, MAX_OBU_HEADER_SIZE))
+	{
+		return 0;
+	}
+
+	obuSize = INTERNAL_peekOBUSize(
+		context->bitstreamData + context->bitstreamIndex,
+		context->bitstreamDataSize - context->bitstreamIndex
+	);
+
+	if (obuSize == 0)
+	{
+		/* Truncated header at the end of the stream */
+		return context->bitstreamIndex < context->bitstreamDataSize;
+	}
+
+	return INTERNAL_readStream(context, obuSize);
+}
+
 static inline int INTERNAL_getNextPacket(
 	Context *context
 ) {
@@ -84,6 +699,11 @@ static inline int INTERNAL_getNextPacket(
 	error.size = 0;
 
 	context->bitstreamIndex += context->currentOBUSize;
+	context->currentOBUSize = 0;
+
+	if (context->readFunc != NULL && !INTERNAL_fillStream(context))
+		return 0;
+
 	if (context->bitstreamIndex >= context->bitstreamDataSize)
 		return 0;
 
@@ -99,209 +719,4040 @@ static inline int INTERNAL_getNextPacket(
 		&spatial_id,
 		&error);
 
-	if (result >= 0)
+	if (result >= 0)
+	{
+		context->currentOBUSize += offset; /* adding header size back in */
+	}
+
+	return result >= 0;
+}
+
+/* Reads the OBU header at data and, for sequence headers and frames, the
+ * parts of the payload the index needs. The parser carries state from one
+ * OBU to the next, so OBUs have to be inspected in stream order.
+ */
+static int INTERNAL_inspectOBU(HeaderParser *parser, uint8_t *data, size_t size, OBUInfo *info)
+{
+	ptrdiff_t offset;
+	size_t payloadSize;
+	int seenFrameHeader;
+	OBPError error;
+
+	error.error = NULL;
+	error.size = 0;
+
+	info->hasExtension = size > 0 && (data[0] & 0x04); /* obu_extension_flag */
+
+	if (obp_get_next_obu(
+		data,
+		size,
+		&info->type,
+		&offset,
+		&payloadSize,
+		&info->temporalID,
+		&info->spatialID,
+		&error) < 0)
+	{
+		return 0;
+	}
+
+	info->size = (size_t) offset + payloadSize;
+	info->hasFrameHeader = 0;
+
+	if (info->type == OBP_OBU_SEQUENCE_HEADER)
+	{
+		if (obp_parse_sequence_header(data + offset, payloadSize, &parser->sequenceHeader, &error) < 0)
+		{
+			return 0;
+		}
+		parser->hasSequenceHeader = 1;
+	}
+	else if (info->type == OBP_OBU_FRAME || info->type == OBP_OBU_FRAME_HEADER)
+	{
+		if (!parser->hasSequenceHeader)
+		{
+			return 0;
+		}
+
+		/* Redundant frame headers have their own OBU type and are never parsed,
+		 * so every header we do get starts a new frame.
+		 */
+		seenFrameHeader = 0;
+		if (obp_parse_frame_header(
+			data + offset,
+			payloadSize,
+			&parser->sequenceHeader,
+			&parser->state,
+			info->temporalID,
+			info->spatialID,
+			&info->frameHeader,
+			&seenFrameHeader,
+			&error) < 0)
+		{
+			return 0;
+		}
+		info->hasFrameHeader = 1;
+	}
+
+	return 1;
+}
+
+static size_t INTERNAL_pageSize(void)
+{
+#if defined(_WIN32)
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	return info.dwPageSize;
+#elif defined(DF_HAVE_MMAP)
+	return (size_t) sysconf(_SC_PAGESIZE);
+#else
+	return 4096;
+#endif
+}
+
+static void INTERNAL_adviseWillNeed(uint8_t *data, size_t size)
+{
+#if defined(DF_HAVE_MMAP) && defined(MADV_WILLNEED)
+	if (size > MMAP_RELEASE_CHUNK)
+	{
+		size = MMAP_RELEASE_CHUNK;
+	}
+	madvise(data, size, MADV_WILLNEED);
+#endif
+}
+
+/* Drops already-decoded pages of a mapped file from our working set.
+ * The mapping is read-only and file-backed, so touching a released page
+ * again (e.g. after df_reset) simply faults it back in from the page cache.
+ */
+static void INTERNAL_releaseConsumedPages(Context *context)
+{
+	size_t pageSize, start, end;
+
+	if (!context->mapped)
+	{
+		return;
+	}
+
+	if (context->bitstreamIndex < context->releasedIndex + (2 * MMAP_RELEASE_CHUNK))
+	{
+		return;
+	}
+
+	pageSize = INTERNAL_pageSize();
+	start = context->releasedIndex;
+	end = (context->bitstreamIndex - MMAP_RELEASE_CHUNK) & ~(pageSize - 1);
+
+#if defined(_WIN32)
+	/* Unlocking pages that were never locked removes them from the working set */
+	VirtualUnlock(context->bitstreamData + start, end - start);
+#elif defined(DF_HAVE_MMAP)
+	madvise(context->bitstreamData + start, end - start, MADV_DONTNEED);
+#endif
+
+	context->releasedIndex = end;
+}
+
+static void INTERNAL_releaseBitstream(uint8_t *data, size_t size, uint8_t mapped)
+{
+	if (mapped)
+	{
+#if defined(_WIN32)
+		UnmapViewOfFile(data);
+#elif defined(DF_HAVE_MMAP)
+		munmap(data, size);
+#endif
+	}
+	else
+	{
+		free(data);
+	}
+}
+
+static void INTERNAL_freeBitstream(Context *context)
+{
+	if (!context->ownsBitstream)
+	{
+		return;
+	}
+
+	INTERNAL_releaseBitstream(context->bitstreamData, context->bitstreamDataSize, context->mapped);
+
+	context->bitstreamData = NULL;
+	context->ownsBitstream = 0;
+	context->mapped = 0;
+}
+
+/* Playlist sources */
+
+static void INTERNAL_freeSource(Source *source)
+{
+	if (source->ownsBitstream)
+	{
+		INTERNAL_releaseBitstream(source->bitstreamData, source->bitstreamDataSize, source->mapped);
+	}
+	free(source);
+}
+
+/* Looks for the first sequence header, like opening a context does */
+static int INTERNAL_findSequenceHeader(Source *source)
+{
+	OBPOBUType obuType;
+	ptrdiff_t offset;
+	size_t obuSize, position;
+	int temporalID, spatialID;
+	OBPError error;
+
+	error.error = NULL;
+	error.size = 0;
+	position = 0;
+
+	while (position < source->bitstreamDataSize)
+	{
+		if (obp_get_next_obu(
+			source->bitstreamData + position,
+			source->bitstreamDataSize - position,
+			&obuType,
+			&offset,
+			&obuSize,
+			&temporalID,
+			&spatialID,
+			&error) < 0)
+		{
+			return 0;
+		}
+		obuSize += offset;
+
+		if (	obuType == OBP_OBU_SEQUENCE_HEADER &&
+			dav1d_parse_sequence_header(&source->sequenceHeader, source->bitstreamData + position, obuSize) == 0	)
+		{
+			source->sequenceHeaderOffset = position;
+			source->sequenceHeaderSize = obuSize;
+			return	source->sequenceHeader.max_width > 0 &&
+				source->sequenceHeader.max_height > 0 &&
+				source->sequenceHeader.layout != DAV1D_PIXEL_LAYOUT_I400;
+		}
+
+		position += obuSize;
+	}
+
+	return 0;
+}
+
+/* dav1d takes a new sequence header in stride, but not a different format or
+ * set of operating points, which the decoder settings refer to by number
+ */
+static int INTERNAL_compatibleSources(const Dav1dSequenceHeader *a, const Dav1dSequenceHeader *b)
+{
+	return	a->layout == b->layout &&
+		a->hbd == b->hbd &&
+		a->num_operating_points == b->num_operating_points;
+}
+
+/* Points the feed at the start of source */
+static void INTERNAL_useSource(Context *context, const Source *source)
+{
+	context->bitstreamData = source->bitstreamData;
+	context->bitstreamDataSize = source->bitstreamDataSize;
+	context->bitstreamIndex = 0;
+	context->currentOBUSize = 0;
+	context->mapped = source->mapped;
+	context->releasedIndex = 0;
+	context->sequenceHeaderOffset = source->sequenceHeaderOffset;
+	context->sequenceHeaderSize = source->sequenceHeaderSize;
+
+	if (context->mapped)
+	{
+		INTERNAL_adviseWillNeed(context->bitstreamData, context->bitstreamDataSize);
+	}
+}
+
+/* The layers of an operating point, a bit per temporal layer and one per spatial
+ * layer from bit 8 up. Points past the stream's last select the last.
+ */
+static uint32_t INTERNAL_operatingPointLayers(const OBPSequenceHeader *sequenceHeader, uint32_t operatingPoint)
+{
+	if (operatingPoint > sequenceHeader->operating_points_cnt_minus_1)
+	{
+		operatingPoint = sequenceHeader->operating_points_cnt_minus_1;
+	}
+
+	/* 0 means the operating point has every layer */
+	if (sequenceHeader->operating_point_idc[operatingPoint] == 0)
+	{
+		return 0xFFF;
+	}
+
+	return sequenceHeader->operating_point_idc[operatingPoint];
+}
+
+/* Takes up the operating point asked for. Layers can be left out from any OBU on,
+ * but a layer that comes back would reference frames of it that were never
+ * decoded, so a point with more layers waits for a key frame that refreshes every
+ * reference slot.
+ */
+static void INTERNAL_updateOperatingPoint(Context *context, const OBUInfo *info, int parsed)
+{
+	const OBPSequenceHeader *sequenceHeader = &context->feedParser->sequenceHeader;
+	uint32_t requested, wanted, current;
+
+	requested = INTERNAL_atomicLoad(&context->operatingPoint);
+	if (requested == context->feedOperatingPoint)
+	{
+		return;
+	}
+
+	/* Nothing was dropped yet */
+	if (!context->feedParser->hasSequenceHeader)
+	{
+		context->feedOperatingPoint = requested;
+		return;
+	}
+
+	wanted = INTERNAL_operatingPointLayers(sequenceHeader, requested);
+	current = INTERNAL_operatingPointLayers(sequenceHeader, context->feedOperatingPoint);
+
+	if (	(wanted & ~current) == 0 ||
+		(	parsed &&
+			info->hasFrameHeader &&
+			info->frameHeader.frame_type == OBP_KEY_FRAME &&
+			info->frameHeader.refresh_frame_flags == 0xFF	)	)
+	{
+		context->feedOperatingPoint = requested;
+	}
+}
+
+/* Whether the OBU belongs to a layer the operating point in use leaves out.
+ * Lower layers never reference higher ones, so the rest still decodes. OBUs
+ * without an extension header belong to every layer.
+ */
+static int INTERNAL_outsideOperatingPoint(Context *context, const OBUInfo *info)
+{
+	uint32_t layers;
+
+	if (	!context->feedParser->hasSequenceHeader ||
+		!info->hasExtension ||
+		info->type == OBP_OBU_SEQUENCE_HEADER ||
+		info->type == OBP_OBU_TEMPORAL_DELIMITER	)
+	{
+		return 0;
+	}
+
+	layers = INTERNAL_operatingPointLayers(&context->feedParser->sequenceHeader, context->feedOperatingPoint);
+
+	return	!((layers >> info->temporalID) & 1) ||
+		!((layers >> (info->spatialID + 8)) & 1);
+}
+
+static void INTERNAL_resetClock(PresentationClock *clock, uint64_t time, uint64_t interval)
+{
+	clock->time = time;
+	clock->interval = interval;
+	clock->presentationTime = 0;
+	clock->started = 0;
+}
+
+/* Moves the clock to the next temporal unit, whose shown frame has frameHeader,
+ * or NULL if it couldn't be parsed. The first unit stays where the clock was set.
+ */
+static void INTERNAL_advanceClock(PresentationClock *clock, const HeaderParser *parser, const OBPFrameHeader *frameHeader)
+{
+	const OBPSequenceHeader *sequenceHeader = &parser->sequenceHeader;
+	uint32_t mask, delta;
+
+	if (	parser->hasSequenceHeader &&
+		sequenceHeader->timing_info_present_flag &&
+		sequenceHeader->timing_info.equal_picture_interval	)
+	{
+		clock->interval = (uint64_t) sequenceHeader->timing_info.num_ticks_per_picture_minus_1 + 1;
+	}
+	else if (	parser->hasSequenceHeader &&
+			sequenceHeader->decoder_model_info_present_flag &&
+			frameHeader != NULL	)
+	{
+		/* Up to 32 bits that wrap, and restart at random access points */
+		mask = UINT32_MAX >> (31 - sequenceHeader->decoder_model_info.frame_presentation_time_length_minus_1);
+		delta = (frameHeader->temporal_point_info.frame_presentation_time - clock->presentationTime) & mask;
+		clock->presentationTime = frameHeader->temporal_point_info.frame_presentation_time;
+
+		if (clock->started && delta != 0 && delta <= mask / 2)
+		{
+			clock->time += delta;
+			clock->interval = delta;
+			return;
+		}
+	}
+
+	if (clock->started)
+	{
+		clock->time += clock->interval;
+	}
+	clock->started = 1;
+}
+
+// 1 = success
+// 0 = end of stream
+// -1 = error
+/* Numbers the temporal unit the OBU belongs to, using the same rules as the
+ * index, and decides whether the OBU can be left out. A frame nothing refers
+ * to can be left out if it comes before skipToFrame, it would only be thrown
+ * away after decoding.
+ */
+static int INTERNAL_feedOBU(Context *context, uint8_t *data, size_t size)
+{
+	OBUInfo *info = context->feedInfo;
+	OBPFrameHeader *frameHeader = &info->frameHeader;
+	int parsed;
+
+	parsed = INTERNAL_inspectOBU(context->feedParser, data, size, info);
+	if (!parsed)
+	{
+		/* Couldn't read it, let dav1d have it and count it as a shown frame */
+		info->hasFrameHeader = info->type == OBP_OBU_FRAME || info->type == OBP_OBU_FRAME_HEADER;
+	}
+
+	if (info->type == OBP_OBU_TEMPORAL_DELIMITER)
+	{
+		context->feedHasTemporalDelimiters = 1;
+	}
+
+	if (	context->feedShown &&
+		(info->type == OBP_OBU_TEMPORAL_DELIMITER || (!context->feedHasTemporalDelimiters && info->hasFrameHeader))	)
+	{
+		context->feedFrame += 1;
+		context->feedShown = 0;
+	}
+
+	if (info->hasFrameHeader)
+	{
+		context->feedDropping =
+			parsed &&
+			frameHeader->refresh_frame_flags == 0 &&
+			context->feedFrame < INTERNAL_atomicLoad(&context->skipToFrame);
+
+		if (!parsed || frameHeader->show_frame || frameHeader->show_existing_frame)
+		{
+			if (!context->feedShown)
+			{
+				INTERNAL_advanceClock(&context->feedClock, context->feedParser, parsed ? frameHeader : NULL);
+			}
+			context->feedShown = 1;
+		}
+	}
+	else if (info->type != OBP_OBU_TILE_GROUP && info->type != OBP_OBU_REDUNDANT_FRAME_HEADER)
+	{
+		context->feedDropping = 0;
+	}
+
+	INTERNAL_updateOperatingPoint(context, info, parsed);
+
+	return !context->feedDropping && !INTERNAL_outsideOperatingPoint(context, info);
+}
+
+/* Takes the feed from the end of the stream back to its start, without a flush.
+ * The start has a key frame, so dav1d just goes on, and temporal units keep
+ * counting up. The clock goes on by the last interval.
+ */
+static int INTERNAL_wrapFeed(Context *context)
+{
+	if (context->readFunc != NULL && context->streamOffset != 0)
+	{
+		if (context->seekFunc == NULL || !context->seekFunc(context->userdata, 0))
+		{
+			return 0;
+		}
+		context->bitstreamDataSize = 0;
+		context->streamOffset = 0;
+		context->streamEnd = 0;
+	}
+
+	context->bitstreamIndex = 0;
+	context->currentOBUSize = 0;
+	context->releasedIndex = 0;
+	INTERNAL_resetClock(
+		&context->feedClock,
+		context->feedClock.time + context->feedClock.interval,
+		context->feedClock.interval
+	);
+
+	if (context->mapped)
+	{
+		INTERNAL_adviseWillNeed(context->bitstreamData, context->bitstreamDataSize);
+	}
+
+	return 1;
+}
+
+/* Moves the feed on to next at the end of the source before it. Numbering and
+ * the clock carry on like when looping. sourceLock is held.
+ */
+static void INTERNAL_enterSource(Context *context, Source *next)
+{
+	next->started = 1;
+	next->firstFrame = context->feedFrame + context->feedShown;
+	next->firstTime = context->feedClock.time + context->feedClock.interval;
+	context->feeding = next;
+
+	INTERNAL_useSource(context, next);
+	INTERNAL_resetClock(&context->feedClock, next->firstTime, context->feedClock.interval);
+}
+
+/* A queued source the decoder takes in stride goes on without waiting for the
+ * decoder to drain, see INTERNAL_nextDecoder for the others. Returns -1 when
+ * the next one needs a decoder of its own.
+ */
+static int INTERNAL_nextSource(Context *context)
+{
+	Source *next;
+
+	INTERNAL_mutexLock(&context->sourceLock);
+
+	next = (context->feeding != NULL) ? context->feeding->next : NULL;
+	if (next == NULL || !next->compatible)
+	{
+		INTERNAL_mutexUnlock(&context->sourceLock);
+		return (next == NULL) ? 0 : -1;
+	}
+
+	INTERNAL_enterSource(context, next);
+
+	INTERNAL_mutexUnlock(&context->sourceLock);
+
+	return 1;
+}
+
+static int df_INTERNAL_read_data(Context *internalContext, Dav1dData *data)
+{
+	uint8_t *packet;
+	uint8_t wrapped;
+	int next;
+
+	wrapped = 0;
+
+	do
+	{
+		while (	(internalContext->readFunc == NULL && internalContext->bitstreamIndex >= internalContext->bitstreamDataSize) ||
+			!INTERNAL_getNextPacket(internalContext)	)
+		{
+			if (internalContext->bitstreamIndex < internalContext->bitstreamDataSize)
+			{
+				return -1;
+			}
+
+			/* A queued source goes before looping. One that needs its own
+			 * decoder waits for this one to drain, see INTERNAL_nextDecoder.
+			 */
+			next = INTERNAL_nextSource(internalContext);
+			if (next > 0)
+			{
+				continue;
+			}
+			if (next < 0)
+			{
+				return 0;
+			}
+
+			/* Once around at most, a stream without a single frame would spin */
+			if (wrapped || !INTERNAL_atomicLoad(&internalContext->loop) || !INTERNAL_wrapFeed(internalContext))
+			{
+				return 0;
+			}
+			wrapped = 1;
+		}
+	} while (!INTERNAL_feedOBU(
+		internalContext,
+		internalContext->bitstreamData + internalContext->bitstreamIndex,
+		internalContext->currentOBUSize
+	));
+
+	if (internalContext->readFunc != NULL)
+	{
+		/* The window will slide under dav1d, so it gets its own copy */
+		packet = dav1d_data_create(data, internalContext->currentOBUSize);
+		if (packet == NULL)
+		{
+			return -1;
+		}
+		memcpy(packet, internalContext->bitstreamData + internalContext->bitstreamIndex, internalContext->currentOBUSize);
+	}
+	else
+	{
+		INTERNAL_releaseConsumedPages(internalContext);
+
+		if (dav1d_data_wrap(data, internalContext->bitstreamData + internalContext->bitstreamIndex, internalContext->currentOBUSize, allocator_no_op, NULL) < 0)
+		{
+			return -1;
+		}
+	}
+
+	/* dav1d hands these back on the picture, so pictures can be matched to the
+	 * temporal unit. The presentation time rides in place of the stream offset.
+	 */
+	data->m.timestamp = (int64_t) internalContext->feedFrame;
+	data->m.offset = (int64_t) internalContext->feedClock.time;
+	data->m.duration = (int64_t) internalContext->feedClock.interval;
+
+	return 1;
+}
+
+void df_default_decoder_settings(DecoderSettings *settings)
+{
+	Dav1dSettings defaults;
+	dav1d_default_settings(&defaults);
+
+	settings->threadCount = defaults.n_threads;
+	settings->maxFrameDelay = defaults.max_frame_delay;
+	settings->operatingPoint = defaults.operating_point;
+	settings->allLayers = (uint8_t) defaults.all_layers;
+	settings->applyGrain = 0; /* Grain is off unless asked for */
+	settings->frameSizeLimit = defaults.frame_size_limit;
+	settings->inloopFilters = (uint32_t) defaults.inloop_filters;
+	settings->decodeFrameType = (uint32_t) defaults.decode_frame_type;
+}
+
+/* Picture memory */
+
+static Allocator* INTERNAL_createAllocator(
+	df_alloc_picture_func alloc,
+	df_release_picture_func release,
+	void *userdata
+) {
+	Allocator *allocator = malloc(sizeof(Allocator));
+	if (!allocator)
+	{
+		return NULL;
+	}
+
+	allocator->alloc = alloc;
+	allocator->release = release;
+	allocator->userdata = userdata;
+	INTERNAL_mutexInit(&allocator->lock);
+	allocator->buckets = NULL;
+	allocator->allocations = 0;
+	allocator->hits = 0;
+	allocator->misses = 0;
+	allocator->refCount = 1;
+	return allocator;
+}
+
+/* Frees recycled pictures, all of them or only the ones of idle formats.
+ * Buckets go too once nothing of theirs is in use. Called with the lock held.
+ */
+static void INTERNAL_trimPictures(Allocator *allocator, uint8_t idleOnly)
+{
+	PictureBucket **link, *bucket;
+	PictureBlock *block;
+
+	link = &allocator->buckets;
+	while ((bucket = *link) != NULL)
+	{
+		if (idleOnly && allocator->allocations - bucket->lastUse <= PICTURE_IDLE_ALLOCATIONS)
+		{
+			link = &bucket->next;
+			continue;
+		}
+
+		while ((block = bucket->freeBlocks) != NULL)
+		{
+			bucket->freeBlocks = block->next;
+			free(block);
+		}
+
+		if (bucket->usedBlocks == 0)
+		{
+			*link = bucket->next;
+			free(bucket);
+		}
+		else
+		{
+			link = &bucket->next;
+		}
+	}
+}
+
+static void INTERNAL_releaseAllocator(Allocator *allocator)
+{
+	if (allocator != NULL && INTERNAL_atomicDecrement(&allocator->refCount) == 0)
+	{
+		/* Every picture is back, so this frees everything */
+		INTERNAL_trimPictures(allocator, 0);
+		INTERNAL_mutexDestroy(&allocator->lock);
+		free(allocator);
+	}
+}
+
+static void INTERNAL_pictureBuffer(const Dav1dPicture *picture, PictureBuffer *buffer)
+{
+	buffer->width = picture->p.w;
+	buffer->height = picture->p.h;
+	buffer->pixelLayout = (PixelLayout) picture->p.layout;
+	buffer->hbd = (uint8_t) ((picture->p.bpc - 8) >> 1);
+	buffer->planes[0] = picture->data[0];
+	buffer->planes[1] = picture->data[1];
+	buffer->planes[2] = picture->data[2];
+	buffer->strides[0] = (uint32_t) picture->stride[0];
+	buffer->strides[1] = (uint32_t) picture->stride[1];
+	buffer->allocatorData = picture->allocator_data;
+}
+
+/* Same layout as dav1d's own allocator */
+static void INTERNAL_pictureLayout(const Dav1dPicture *picture, ptrdiff_t strides[2], size_t *lumaSize, size_t *chromaSize)
+{
+	const int hbd = picture->p.bpc > 8;
+	const int ssHor = picture->p.layout != DAV1D_PIXEL_LAYOUT_I444;
+	const int ssVer = picture->p.layout == DAV1D_PIXEL_LAYOUT_I420;
+	const int alignedW = (picture->p.w + 127) & ~127;
+	const int alignedH = (picture->p.h + 127) & ~127;
+
+	strides[0] = (ptrdiff_t) alignedW << hbd;
+	strides[1] = strides[0] >> ssHor;
+
+	/* Strides that are multiples of 1024 alias in the cache */
+	if (!(strides[0] & 1023))
+	{
+		strides[0] += DAV1D_PICTURE_ALIGNMENT;
+	}
+	if (!(strides[1] & 1023))
+	{
+		strides[1] += DAV1D_PICTURE_ALIGNMENT;
+	}
+
+	*lumaSize = (size_t) strides[0] * alignedH;
+	*chromaSize = (size_t) strides[1] * (alignedH >> ssVer);
+}
+
+static int INTERNAL_allocRecycled(Allocator *allocator, Dav1dPicture *picture)
+{
+	PictureBucket *bucket;
+	PictureBlock *block;
+	ptrdiff_t strides[2];
+	size_t lumaSize, chromaSize;
+	uint8_t *data;
+
+	INTERNAL_pictureLayout(picture, strides, &lumaSize, &chromaSize);
+
+	INTERNAL_mutexLock(&allocator->lock);
+
+	allocator->allocations += 1;
+
+	for (bucket = allocator->buckets; bucket != NULL; bucket = bucket->next)
+	{
+		if (	bucket->width == picture->p.w &&
+			bucket->height == picture->p.h &&
+			bucket->layout == (int32_t) picture->p.layout &&
+			bucket->bpc == picture->p.bpc	)
+		{
+			break;
+		}
+	}
+
+	if (bucket == NULL)
+	{
+		/* New format, probably a new resolution, so the old ones can go */
+		INTERNAL_trimPictures(allocator, 1);
+
+		bucket = malloc(sizeof(PictureBucket));
+		if (!bucket)
+		{
+			INTERNAL_mutexUnlock(&allocator->lock);
+			return DAV1D_ERR(ENOMEM);
+		}
+		bucket->width = picture->p.w;
+		bucket->height = picture->p.h;
+		bucket->layout = (int32_t) picture->p.layout;
+		bucket->bpc = picture->p.bpc;
+		bucket->freeBlocks = NULL;
+		bucket->usedBlocks = 0;
+		bucket->next = allocator->buckets;
+		allocator->buckets = bucket;
+	}
+
+	bucket->lastUse = allocator->allocations;
+
+	block = bucket->freeBlocks;
+	if (block != NULL)
+	{
+		bucket->freeBlocks = block->next;
+		allocator->hits += 1;
+	}
+	else
+	{
+		/* The data starts at the first aligned address past the header, and is padded */
+		block = malloc(sizeof(PictureBlock) + lumaSize + chromaSize * 2 + DAV1D_PICTURE_ALIGNMENT * 2);
+		if (!block)
+		{
+			INTERNAL_mutexUnlock(&allocator->lock);
+			return DAV1D_ERR(ENOMEM);
+		}
+		block->bucket = bucket;
+		allocator->misses += 1;
+	}
+	bucket->usedBlocks += 1;
+
+	INTERNAL_mutexUnlock(&allocator->lock);
+
+	data = (uint8_t*) (
+		((uintptr_t) (block + 1) + DAV1D_PICTURE_ALIGNMENT - 1) &
+		~(uintptr_t) (DAV1D_PICTURE_ALIGNMENT - 1)
+	);
+
+	picture->data[0] = data;
+	picture->data[1] = data + lumaSize;
+	picture->data[2] = data + lumaSize + chromaSize;
+	picture->stride[0] = strides[0];
+	picture->stride[1] = strides[1];
+	picture->allocator_data = block;
+	return 0;
+}
+
+static void INTERNAL_releaseRecycled(Allocator *allocator, Dav1dPicture *picture)
+{
+	PictureBlock *block = (PictureBlock*) picture->allocator_data;
+	PictureBucket *bucket = block->bucket;
+
+	INTERNAL_mutexLock(&allocator->lock);
+
+	bucket->usedBlocks -= 1;
+	if (allocator->allocations - bucket->lastUse > PICTURE_IDLE_ALLOCATIONS)
+	{
+		/* Left over from an old resolution */
+		free(block);
+		INTERNAL_trimPictures(allocator, 1);
+	}
+	else
+	{
+		block->next = bucket->freeBlocks;
+		bucket->freeBlocks = block;
+	}
+
+	INTERNAL_mutexUnlock(&allocator->lock);
+}
+
+static int INTERNAL_allocPicture(Dav1dPicture *picture, void *cookie)
+{
+	Allocator *allocator = (Allocator*) cookie;
+	PictureBuffer buffer;
+	uintptr_t misaligned;
+	int result;
+
+	if (allocator->alloc == NULL)
+	{
+		result = INTERNAL_allocRecycled(allocator, picture);
+		if (result == 0)
+		{
+			INTERNAL_atomicIncrement(&allocator->refCount);
+		}
+		return result;
+	}
+
+	memset(&buffer, '\0', sizeof(PictureBuffer));
+	INTERNAL_pictureBuffer(picture, &buffer);
+
+	if (!allocator->alloc(allocator->userdata, &buffer))
+	{
+		return DAV1D_ERR(ENOMEM);
+	}
+
+	/* dav1d reads and writes whole aligned blocks */
+	misaligned =
+		((uintptr_t) buffer.planes[0] | (uintptr_t) buffer.planes[1] | (uintptr_t) buffer.planes[2] |
+		buffer.strides[0] | buffer.strides[1]) & (DAV1D_PICTURE_ALIGNMENT - 1);
+	if (misaligned || buffer.planes[0] == NULL)
+	{
+		allocator->release(allocator->userdata, &buffer);
+		return DAV1D_ERR(EINVAL);
+	}
+
+	picture->data[0] = buffer.planes[0];
+	picture->data[1] = buffer.planes[1];
+	picture->data[2] = buffer.planes[2];
+	picture->stride[0] = buffer.strides[0];
+	picture->stride[1] = buffer.strides[1];
+	picture->allocator_data = buffer.allocatorData;
+
+	INTERNAL_atomicIncrement(&allocator->refCount);
+	return 0;
+}
+
+static void INTERNAL_releasePicture(Dav1dPicture *picture, void *cookie)
+{
+	Allocator *allocator = (Allocator*) cookie;
+	PictureBuffer buffer;
+
+	if (allocator->alloc == NULL)
+	{
+		INTERNAL_releaseRecycled(allocator, picture);
+	}
+	else
+	{
+		INTERNAL_pictureBuffer(picture, &buffer);
+		allocator->release(allocator->userdata, &buffer);
+	}
+
+	/* The last picture can outlive the context */
+	INTERNAL_releaseAllocator(allocator);
+}
+
+static int INTERNAL_openDecoder(
+	const DecoderSettings *decoderSettings,
+	Allocator *allocator,
+	Dav1dContext **dav1dContext
+) {
+	Dav1dSettings settings;
+
+	dav1d_default_settings(&settings);
+	settings.n_threads = decoderSettings->threadCount;
+	settings.max_frame_delay = decoderSettings->maxFrameDelay;
+	settings.operating_point = decoderSettings->operatingPoint;
+	settings.all_layers = decoderSettings->allLayers;
+	settings.apply_grain = 0;
+	settings.frame_size_limit = decoderSettings->frameSizeLimit;
+	settings.inloop_filters = (enum Dav1dInloopFilterType) (decoderSettings->inloopFilters & INLOOP_FILTER_ALL);
+	settings.decode_frame_type = (enum Dav1dDecodeFrameType) decoderSettings->decodeFrameType;
+
+	if (allocator != NULL)
+	{
+		settings.allocator.cookie = allocator;
+		settings.allocator.alloc_picture_callback = INTERNAL_allocPicture;
+		settings.allocator.release_picture_callback = INTERNAL_releasePicture;
+	}
+
+	return dav1d_open(dav1dContext, &settings) == 0;
+}
+
+/* Playlist feed */
+
+/* Drained, so a queued source that needs a decoder of its own can start */
+static int INTERNAL_nextDecoder(Context *context)
+{
+	Source *next;
+	Dav1dContext *dav1dContext;
+
+	INTERNAL_mutexLock(&context->sourceLock);
+
+	next = (context->feeding != NULL) ? context->feeding->next : NULL;
+	if (next == NULL)
+	{
+		INTERNAL_mutexUnlock(&context->sourceLock);
+		return 0;
+	}
+
+	if (!next->compatible)
+	{
+		dav1dContext = NULL;
+		if (!INTERNAL_openDecoder(&context->settings, context->allocator, &dav1dContext))
+		{
+			INTERNAL_mutexUnlock(&context->sourceLock);
+			return 0;
+		}
+		dav1d_close(&context->dav1dContext);
+		context->dav1dContext = dav1dContext;
+	}
+
+	INTERNAL_enterSource(context, next);
+
+	INTERNAL_mutexUnlock(&context->sourceLock);
+
+	return 1;
+}
+
+/* Brings the feed back to the source being played, so it can be repositioned.
+ * Decoding is paused and the decoder flushed or new.
+ */
+static void INTERNAL_rollbackFeed(Context *context)
+{
+	Source *source;
+	uint8_t moved;
+
+	if (context->playing == NULL)
+	{
+		return;
+	}
+
+	INTERNAL_mutexLock(&context->sourceLock);
+	for (source = context->playing->next; source != NULL; source = source->next)
+	{
+		source->started = 0;
+	}
+	moved = context->feeding != context->playing;
+	context->feeding = context->playing;
+	INTERNAL_mutexUnlock(&context->sourceLock);
+
+	if (moved)
+	{
+		INTERNAL_useSource(context, context->playing);
+	}
+}
+
+/* The bitstream of the source being played, the feed may be further along */
+static void INTERNAL_playingBitstream(Context *context, uint8_t **data, size_t *size)
+{
+	if (context->playing != NULL)
+	{
+		*data = context->playing->bitstreamData;
+		*size = context->playing->bitstreamDataSize;
+	}
+	else
+	{
+		*data = context->bitstreamData;
+		*size = context->bitstreamDataSize;
+	}
+}
+
+static int INTERNAL_hasNextSource(Context *context)
+{
+	int result;
+
+	if (context->playing == NULL)
+	{
+		return 0;
+	}
+
+	INTERNAL_mutexLock(&context->sourceLock);
+	result = context->playing->next != NULL;
+	INTERNAL_mutexUnlock(&context->sourceLock);
+
+	return result;
+}
+
+/* Looping repeats the last source, the index of one before it just ends */
+static int INTERNAL_indexLoops(Context *context)
+{
+	return INTERNAL_atomicLoad(&context->loop) && !INTERNAL_hasNextSource(context);
+}
+
+static void INTERNAL_waitForIndex(Context *context)
+{
+	if (context->indexThreadRunning)
+	{
+		INTERNAL_threadJoin(context->indexThread);
+		context->indexThreadRunning = 0;
+	}
+}
+
+/* Moves the reader on to the source the frame it just got came from. The
+ * sources before it are done with, and so is the index, which was of one of them.
+ */
+static void INTERNAL_followSource(Context *context, uint32_t frame)
+{
+	Source *playing, *next;
+	const Dav1dSequenceHeader *sequenceHeader;
+
+	if (context->playing == NULL)
+	{
+		return;
+	}
+
+	INTERNAL_mutexLock(&context->sourceLock);
+	playing = context->playing;
+	while (playing->next != NULL && playing->next->started && frame >= playing->next->firstFrame)
+	{
+		playing = playing->next;
+	}
+	INTERNAL_mutexUnlock(&context->sourceLock);
+
+	if (playing == context->playing)
+	{
+		return;
+	}
+
+	/* The index thread reads the source playing */
+	INTERNAL_waitForIndex(context);
+
+	INTERNAL_mutexLock(&context->sourceLock);
+	while (context->playing != playing)
+	{
+		next = context->playing->next;
+		INTERNAL_freeSource(context->playing);
+		context->playing = next;
+	}
+	INTERNAL_mutexUnlock(&context->sourceLock);
+
+	free(context->index);
+	context->index = NULL;
+	context->indexCount = 0;
+	context->indexState = INDEX_STATE_NONE;
+
+	sequenceHeader = &playing->sequenceHeader;
+	context->width = sequenceHeader->max_width;
+	context->height = sequenceHeader->max_height;
+	context->pixelLayout = (PixelLayout) sequenceHeader->layout;
+	context->hbd = sequenceHeader->hbd;
+
+	context->timing_info_present = sequenceHeader->timing_info_present;
+	context->num_units_in_tick = sequenceHeader->num_units_in_tick;
+	context->time_scale = sequenceHeader->time_scale;
+	context->equal_picture_interval = sequenceHeader->equal_picture_interval;
+	context->num_ticks_per_picture = sequenceHeader->num_ticks_per_picture;
+
+	context->frameBase = playing->firstFrame;
+	context->timeBase = playing->firstTime;
+}
+
+/* Index files */
+
+static inline void INTERNAL_writeU32(uint8_t *dst, uint32_t value)
+{
+	dst[0] = (uint8_t) value;
+	dst[1] = (uint8_t) (value >> 8);
+	dst[2] = (uint8_t) (value >> 16);
+	dst[3] = (uint8_t) (value >> 24);
+}
+
+static inline void INTERNAL_writeU64(uint8_t *dst, uint64_t value)
+{
+	INTERNAL_writeU32(dst, (uint32_t) value);
+	INTERNAL_writeU32(dst + 4, (uint32_t) (value >> 32));
+}
+
+static inline uint32_t INTERNAL_readU32(const uint8_t *src)
+{
+	return	(uint32_t) src[0] |
+		((uint32_t) src[1] << 8) |
+		((uint32_t) src[2] << 16) |
+		((uint32_t) src[3] << 24);
+}
+
+static inline uint64_t INTERNAL_readU64(const uint8_t *src)
+{
+	return (uint64_t) INTERNAL_readU32(src) | ((uint64_t) INTERNAL_readU32(src + 4) << 32);
+}
+
+static uint64_t INTERNAL_hashBytes(uint64_t hash, const uint8_t *data, size_t size)
+{
+	size_t i;
+
+	/* FNV-1a */
+	for (i = 0; i < size; i += 1)
+	{
+		hash ^= data[i];
+		hash *= 0x100000001B3ULL;
+	}
+
+	return hash;
+}
+
+/* Only the ends of the bitstream are hashed, so checking an index file costs
+ * the same for every file size. Together with the size that catches a
+ * re-encoded or replaced file.
+ */
+static uint64_t INTERNAL_hashBitstream(const uint8_t *data, size_t size)
+{
+	uint8_t sizeBytes[8];
+	uint64_t hash = 0xCBF29CE484222325ULL;
+	size_t chunk = (size < INDEX_HASH_CHUNK) ? size : INDEX_HASH_CHUNK;
+
+	INTERNAL_writeU64(sizeBytes, size);
+	hash = INTERNAL_hashBytes(hash, sizeBytes, sizeof(sizeBytes));
+	hash = INTERNAL_hashBytes(hash, data, chunk);
+	hash = INTERNAL_hashBytes(hash, data + size - chunk, chunk);
+
+	return hash;
+}
+
+static int INTERNAL_readIndexFile(const char *fname, IndexFile *indexFile)
+{
+	FILE *file;
+	uint8_t header[INDEX_FILE_HEADER_SIZE];
+	uint8_t *entries;
+	const uint8_t *src;
+	uint32_t i;
+
+	indexFile->entries = NULL;
+	indexFile->count = 0;
+
+	file = fopen(fname, "rb");
+	if (!file)
+	{
+		return 0;
+	}
+
+	if (	fread(header, 1, sizeof(header), file) != sizeof(header) ||
+		memcmp(header, "DFIX", 4) != 0 ||
+		INTERNAL_readU32(header + 4) != INDEX_FILE_VERSION	)
+	{
+		fclose(file);
+		return 0;
+	}
+
+	indexFile->bitstreamSize = INTERNAL_readU64(header + 8);
+	indexFile->bitstreamHash = INTERNAL_readU64(header + 16);
+	indexFile->width = (int32_t) INTERNAL_readU32(header + 24);
+	indexFile->height = (int32_t) INTERNAL_readU32(header + 28);
+	indexFile->pixelLayout = header[32];
+	indexFile->hbd = header[33];
+	indexFile->timing_info_present = header[34];
+	indexFile->equal_picture_interval = header[35];
+	indexFile->num_units_in_tick = INTERNAL_readU32(header + 36);
+	indexFile->time_scale = INTERNAL_readU32(header + 40);
+	indexFile->num_ticks_per_picture = INTERNAL_readU32(header + 44);
+	indexFile->sequenceHeaderOffset = INTERNAL_readU64(header + 48);
+	indexFile->sequenceHeaderSize = INTERNAL_readU64(header + 56);
+	indexFile->count = INTERNAL_readU32(header + 64);
+
+	/* There are no empty temporal units, so a sane count is bounded by the bitstream */
+	if (	indexFile->count == 0 ||
+		indexFile->count > indexFile->bitstreamSize ||
+		(uint64_t) indexFile->count * sizeof(FrameInfo) > SIZE_MAX	)
+	{
+		fclose(file);
+		return 0;
+	}
+
+	entries = malloc((size_t) indexFile->count * INDEX_FILE_ENTRY_SIZE);
+	indexFile->entries = malloc(sizeof(FrameInfo) * indexFile->count);
+	if (	!entries ||
+		!indexFile->entries ||
+		fread(entries, INDEX_FILE_ENTRY_SIZE, indexFile->count, file) != indexFile->count	)
+	{
+		fclose(file);
+		free(entries);
+		free(indexFile->entries);
+		indexFile->entries = NULL;
+		return 0;
+	}
+	fclose(file);
+
+	for (i = 0; i < indexFile->count; i += 1)
+	{
+		src = entries + (size_t) i * INDEX_FILE_ENTRY_SIZE;
+		indexFile->entries[i].offset = INTERNAL_readU64(src);
+		indexFile->entries[i].size = INTERNAL_readU32(src + 8);
+		indexFile->entries[i].frameType = (FrameType) (src[12] & 3);
+		indexFile->entries[i].keyFrame = src[13];
+		indexFile->entries[i].showExistingFrame = src[14];
+		indexFile->entries[i].refreshFrameFlags = src[15];
+		indexFile->entries[i].presentationTime = INTERNAL_readU64(src + 16);
+	}
+
+	free(entries);
+	return 1;
+}
+
+/* Makes sure the index file was written for this bitstream and can't send us out of bounds */
+static int INTERNAL_checkIndexFile(const IndexFile *indexFile, const uint8_t *data, size_t size)
+{
+	uint32_t i;
+
+	if (	indexFile->entries == NULL ||
+		indexFile->bitstreamSize != size ||
+		indexFile->bitstreamHash != INTERNAL_hashBitstream(data, size) ||
+		indexFile->sequenceHeaderOffset >= size ||
+		indexFile->sequenceHeaderSize > size - indexFile->sequenceHeaderOffset	)
+	{
+		return 0;
+	}
+
+	for (i = 0; i < indexFile->count; i += 1)
+	{
+		if (	indexFile->entries[i].offset >= size ||
+			indexFile->entries[i].size > size - indexFile->entries[i].offset	)
+		{
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+static char* INTERNAL_indexFileName(const char *fname)
+{
+	size_t len = strlen(fname);
+	char *indexName = malloc(len + sizeof(INDEX_FILE_EXTENSION));
+
+	if (indexName)
+	{
+		memcpy(indexName, fname, len);
+		memcpy(indexName + len, INDEX_FILE_EXTENSION, sizeof(INDEX_FILE_EXTENSION));
+	}
+
+	return indexName;
+}
+
+/* Reads fname's sidecar if there is one. Checking it against the bitstream is up to INTERNAL_open. */
+static void INTERNAL_findIndexFile(const char *fname, IndexFile *indexFile)
+{
+	char *indexName = INTERNAL_indexFileName(fname);
+
+	indexFile->entries = NULL;
+	if (indexName)
+	{
+		INTERNAL_readIndexFile(indexName, indexFile);
+		free(indexName);
+	}
+}
+
+static int INTERNAL_open(
+	uint8_t *bytes,
+	size_t size,
+	df_read_func readFunc,
+	df_seek_func seekFunc,
+	void *userdata,
+	const DecoderSettings *settings,
+	IndexFile *indexFile,
+	AV1_Context **context
+) {
+	Context *internalContext = malloc(sizeof(Context));
+	if (!internalContext)
+	{
+		return 0;
+	}
+	Dav1dSequenceHeader sequenceHeader;
+
+	internalContext->bitstreamData = bytes;
+	internalContext->bitstreamDataSize = size;
+	internalContext->bitstreamIndex = 0;
+	internalContext->currentOBUSize = 0;
+	internalContext->ownsBitstream = readFunc != NULL;
+	internalContext->mapped = 0;
+	internalContext->releasedIndex = 0;
+	internalContext->readFunc = readFunc;
+	internalContext->seekFunc = seekFunc;
+	internalContext->userdata = userdata;
+	internalContext->streamBufferCapacity = STREAM_BUFFER_SIZE;
+	internalContext->streamOffset = 0;
+	internalContext->streamEnd = 0;
+	internalContext->streamPinned = 1;
+	internalContext->eof = 0;
+	internalContext->width = 0;
+	internalContext->height = 0;
+	internalContext->hbd = 0;
+	internalContext->timing_info_present = 0;
+	internalContext->num_units_in_tick = 0;
+	internalContext->time_scale = 0;
+	internalContext->equal_picture_interval = 0;
+	internalContext->num_ticks_per_picture = 0;
+	internalContext->pool = NULL;
+	internalContext->poolNext = NULL;
+	internalContext->ownsPool = 0;
+	internalContext->frameQueue = NULL;
+	internalContext->frameQueueCapacity = 0;
+	internalContext->frameWriteIndex = 0;
+	internalContext->frameReleaseIndex = 0;
+	internalContext->frameAcquireIndex = 0;
+	internalContext->decodeResult = 1;
+	internalContext->decodeBusy = 0;
+	internalContext->decodePaused = 0;
+	internalContext->sequenceHeaderOffset = 0;
+	internalContext->sequenceHeaderSize = 0;
+	internalContext->feedFrame = 0;
+	internalContext->feedShown = 0;
+	internalContext->feedHasTemporalDelimiters = 0;
+	internalContext->feedDropping = 0;
+	INTERNAL_resetClock(&internalContext->feedClock, 0, 1);
+	internalContext->skipToFrame = 0;
+	internalContext->loop = 0;
+	internalContext->nextFrame = 0;
+	internalContext->playing = NULL;
+	internalContext->feeding = NULL;
+	internalContext->frameBase = 0;
+	internalContext->timeBase = 0;
+	internalContext->converter = NULL;
+	internalContext->rgbaRowFunc = NULL;
+	internalContext->renderCrop = 0;
+	internalContext->convertScratch = NULL;
+	internalContext->convertScratchWidth = 0;
+	internalContext->index = NULL;
+	internalContext->indexCount = 0;
+	internalContext->indexState = INDEX_STATE_NONE;
+	internalContext->indexThreadRunning = 0;
+	memset(&internalContext->pendingData, '\0', sizeof(Dav1dData));
+	memset(&internalContext->currentPicture, '\0', sizeof(Dav1dPicture));
+
+	if (settings != NULL)
+	{
+		internalContext->settings = *settings;
+	}
+	else
+	{
+		df_default_decoder_settings(&internalContext->settings);
+	}
+	internalContext->operatingPoint = (uint32_t) internalContext->settings.operatingPoint;
+	internalContext->feedOperatingPoint = internalContext->operatingPoint;
+	internalContext->applyGrain = internalContext->settings.applyGrain != 0;
+
+	internalContext->feedParser = calloc(1, sizeof(HeaderParser));
+	internalContext->feedInfo = malloc(sizeof(OBUInfo));
+	internalContext->allocator = INTERNAL_createAllocator(NULL, NULL, NULL);
+	internalContext->dav1dContext = NULL;
+	if (	!internalContext->feedParser ||
+		!internalContext->feedInfo ||
+		!internalContext->allocator ||
+		!INTERNAL_openDecoder(&internalContext->settings, internalContext->allocator, &internalContext->dav1dContext)	)
+	{
+		free(internalContext->feedParser);
+		free(internalContext->feedInfo);
+		INTERNAL_releaseAllocator(internalContext->allocator);
+		INTERNAL_freeBitstream(internalContext);
+		free(internalContext);
+		return 0;
+	}
+
+	if (indexFile != NULL && readFunc == NULL && INTERNAL_checkIndexFile(indexFile, bytes, size))
+	{
+		/* Everything the scan below would find is in the index file */
+		internalContext->sequenceHeaderOffset = (size_t) indexFile->sequenceHeaderOffset;
+		internalContext->sequenceHeaderSize = (size_t) indexFile->sequenceHeaderSize;
+
+		internalContext->width = indexFile->width;
+		internalContext->height = indexFile->height;
+		internalContext->pixelLayout = (PixelLayout) indexFile->pixelLayout;
+		internalContext->hbd = indexFile->hbd;
+
+		internalContext->timing_info_present = indexFile->timing_info_present;
+		internalContext->num_units_in_tick = indexFile->num_units_in_tick;
+		internalContext->time_scale = indexFile->time_scale;
+		internalContext->equal_picture_interval = indexFile->equal_picture_interval;
+		internalContext->num_ticks_per_picture = indexFile->num_ticks_per_picture;
+
+		internalContext->index = indexFile->entries;
+		internalContext->indexCount = indexFile->count;
+		internalContext->indexState = INDEX_STATE_READY;
+		indexFile->entries = NULL;
+	}
+	else while (INTERNAL_getNextPacket(internalContext))
+	{
+		if (dav1d_parse_sequence_header(
+				&sequenceHeader,
+				internalContext->bitstreamData + internalContext->bitstreamIndex,
+				internalContext->currentOBUSize
+			) == 0)
+		{
+			internalContext->sequenceHeaderOffset = internalContext->bitstreamIndex;
+			internalContext->sequenceHeaderSize = internalContext->currentOBUSize;
+
+			internalContext->width = sequenceHeader.max_width;
+			internalContext->height = sequenceHeader.max_height;
+			internalContext->pixelLayout = (PixelLayout) sequenceHeader.layout;
+			internalContext->hbd = sequenceHeader.hbd;
+
+			internalContext->timing_info_present = sequenceHeader.timing_info_present;
+			internalContext->num_units_in_tick = sequenceHeader.num_units_in_tick;
+			internalContext->time_scale = sequenceHeader.time_scale;
+			internalContext->equal_picture_interval = sequenceHeader.equal_picture_interval;
+			internalContext->num_ticks_per_picture = sequenceHeader.num_ticks_per_picture;
+			break;
+		}
+	}
+
+	/* Did not find a valid sequence header! */
+	if (internalContext->width == 0 || internalContext->height == 0 || internalContext->pixelLayout == PIXEL_LAYOUT_I400)
+	{
+		free(internalContext->index);
+		free(internalContext->feedParser);
+		free(internalContext->feedInfo);
+		dav1d_close(&internalContext->dav1dContext);
+		INTERNAL_releaseAllocator(internalContext->allocator);
+		INTERNAL_freeBitstream(internalContext);
+		free(internalContext);
+		return 0;
+	}
+
+	/* Reset the stream index. Streams were pinned, so the start is still buffered. */
+	internalContext->bitstreamIndex = 0;
+	internalContext->currentOBUSize = 0;
+	internalContext->streamPinned = 0;
+
+	INTERNAL_mutexInit(&internalContext->sourceLock);
+
+	*context = (AV1_Context*) internalContext;
+
+	return 1;
+}
+
+int df_open_from_memory(uint8_t *bytes, uint32_t size, AV1_Context **context)
+{
+	return INTERNAL_open(bytes, size, NULL, NULL, NULL, NULL, NULL, context);
+}
+
+int df_open_from_memory64(uint8_t *bytes, uint64_t size, AV1_Context **context)
+{
+	/* Can't address it anyway */
+	if (size > SIZE_MAX)
+	{
+		return 0;
+	}
+
+	return INTERNAL_open(bytes, (size_t) size, NULL, NULL, NULL, NULL, NULL, context);
+}
+
+int df_open_from_callbacks(
+	df_read_func readFunc,
+	df_seek_func seekFunc,
+	void *userdata,
+	AV1_Context **context
+) {
+	if (readFunc == NULL)
+	{
+		return 0;
+	}
+
+	return INTERNAL_open(NULL, 0, readFunc, seekFunc, userdata, NULL, NULL, context);
+}
+
+int df_open_ex(
+	uint8_t *bytes,
+	uint64_t size,
+	const DecoderSettings *settings,
+	AV1_Context **context
+) {
+	if (size > SIZE_MAX)
+	{
+		return 0;
+	}
+
+	return INTERNAL_open(bytes, (size_t) size, NULL, NULL, NULL, settings, NULL, context);
+}
+
+int df_open_from_callbacks_ex(
+	df_read_func readFunc,
+	df_seek_func seekFunc,
+	void *userdata,
+	const DecoderSettings *settings,
+	AV1_Context **context
+) {
+	if (readFunc == NULL)
+	{
+		return 0;
+	}
+
+	return INTERNAL_open(NULL, 0, readFunc, seekFunc, userdata, settings, NULL, context);
+}
+
+#if defined(_WIN32)
+#define INTERNAL_ftell _ftelli64
+#define INTERNAL_fseek _fseeki64
+#else
+#define INTERNAL_ftell ftello
+#define INTERNAL_fseek fseeko
+#endif
+
+/* Reads the rest of the file and closes it */
+static uint8_t* INTERNAL_readFile(FILE *file, size_t *size)
+{
+	int64_t start, end;
+	size_t len, result;
+
+	start = INTERNAL_ftell(file);
+	INTERNAL_fseek(file, 0, SEEK_END);
+	end = INTERNAL_ftell(file);
+	INTERNAL_fseek(file, start, SEEK_SET);
+
+	if (start < 0 || end <= start || (uint64_t) (end - start) > SIZE_MAX)
+	{
+		fclose(file);
+		return NULL;
+	}
+	len = (size_t) (end - start);
+
+	unsigned char *bytes = malloc(len);
+	if (!bytes)
+	{
+		fclose(file);
+		return NULL;
+	}
+
+	result = fread(bytes, 1, len, file);
+	fclose(file);
+
+	if (result != len)
+	{
+		free(bytes);
+		return NULL;
+	}
+
+	*size = len;
+	return bytes;
+}
+
+static int df_open_from_file(
+	FILE *file,
+	const DecoderSettings *settings,
+	IndexFile *indexFile,
+	AV1_Context **context
+) {
+	uint8_t *bytes;
+	size_t len;
+
+	bytes = INTERNAL_readFile(file, &len);
+	if (!bytes)
+	{
+		return 0;
+	}
+
+	if (!INTERNAL_open(bytes, len, NULL, NULL, NULL, settings, indexFile, context))
+	{
+		free(bytes);
+		return 0;
+	}
+
+	((Context*) *context)->ownsBitstream = 1;
+	return 1;
+}
+
+int df_fopen_ex(const char *fname, const DecoderSettings *settings, AV1_Context **context)
+{
+	FILE *f = fopen(fname, "rb");
+	IndexFile indexFile;
+	int result;
+
+	if (f)
+	{
+		INTERNAL_findIndexFile(fname, &indexFile);
+		result = df_open_from_file(f, settings, &indexFile, context);
+		free(indexFile.entries);
+		return result;
+	}
+
+	return 0;
+}
+
+int df_fopen(const char *fname, AV1_Context **context)
+{
+	return df_fopen_ex(fname, NULL, context);
+}
+
+int df_mmap_open(const char *fname, AV1_Context **context)
+{
+	return df_mmap_open_ex(fname, NULL, context);
+}
+
+#if !defined(_WIN32) && !defined(DF_HAVE_MMAP)
+
+int df_mmap_open_ex(const char *fname, const DecoderSettings *settings, AV1_Context **context)
+{
+	/* No mapping support on this platform, just read the file */
+	return df_fopen_ex(fname, settings, context);
+}
+
+#else
+
+/* Maps the whole file read-only, released with INTERNAL_releaseBitstream */
+static uint8_t* INTERNAL_mapFile(const char *fname, size_t *size)
+{
+	uint8_t *bytes;
+	uint64_t len;
+#if defined(_WIN32)
+	HANDLE file, mapping;
+	LARGE_INTEGER fileSize;
+
+	file = CreateFileA(
+		fname,
+		GENERIC_READ,
+		FILE_SHARE_READ,
+		NULL,
+		OPEN_EXISTING,
+		FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN,
+		NULL
+	);
+	if (file == INVALID_HANDLE_VALUE)
+	{
+		return NULL;
+	}
+
+	if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0)
+	{
+		CloseHandle(file);
+		return NULL;
+	}
+	len = (uint64_t) fileSize.QuadPart;
+
+	/* The whole file has to fit in our address space */
+	if (len > SIZE_MAX)
+	{
+		CloseHandle(file);
+		return NULL;
+	}
+
+	mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+	CloseHandle(file);
+	if (mapping == NULL)
+	{
+		return NULL;
+	}
+
+	/* The view keeps the mapping object alive */
+	bytes = (uint8_t*) MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	CloseHandle(mapping);
+	if (bytes == NULL)
+	{
+		return NULL;
+	}
+#elif defined(DF_HAVE_MMAP)
+	int fd;
+	struct stat st;
+	void *mapping;
+
+	fd = open(fname, O_RDONLY);
+	if (fd < 0)
+	{
+		return NULL;
+	}
+
+	if (fstat(fd, &st) != 0 || st.st_size <= 0)
+	{
+		close(fd);
+		return NULL;
+	}
+	len = (uint64_t) st.st_size;
+
+	/* The whole file has to fit in our address space */
+	if (len > SIZE_MAX)
+	{
+		close(fd);
+		return NULL;
+	}
+
+	/* The mapping stays valid after the descriptor is closed */
+	mapping = mmap(NULL, (size_t) len, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (mapping == MAP_FAILED)
+	{
+		return NULL;
+	}
+	bytes = (uint8_t*) mapping;
+
+#ifdef MADV_SEQUENTIAL
+	madvise(bytes, (size_t) len, MADV_SEQUENTIAL);
+#endif
+#endif
+
+	*size = (size_t) len;
+	return bytes;
+}
+
+int df_mmap_open_ex(const char *fname, const DecoderSettings *settings, AV1_Context **context)
+{
+	uint8_t *bytes;
+	size_t len;
+	IndexFile indexFile;
+	int result;
+
+	bytes = INTERNAL_mapFile(fname, &len);
+	if (bytes == NULL)
+	{
+		return 0;
+	}
+
+	INTERNAL_adviseWillNeed(bytes, len);
+
+	INTERNAL_findIndexFile(fname, &indexFile);
+	result = INTERNAL_open(bytes, len, NULL, NULL, NULL, settings, &indexFile, context);
+	free(indexFile.entries);
+
+	if (!result)
+	{
+		INTERNAL_releaseBitstream(bytes, len, 1);
+		return 0;
+	}
+
+	((Context*) *context)->ownsBitstream = 1;
+	((Context*) *context)->mapped = 1;
+	return 1;
+}
+
+#endif /* !_WIN32 && !DF_HAVE_MMAP */
+
+void df_videoinfo(
+	AV1_Context *context,
+	int *width,
+	int *height,
+	PixelLayout *pixelLayout
+) {
+	Context *internalContext = (Context*) context;
+
+	*width = internalContext->width;
+	*height = internalContext->height;
+	*pixelLayout = internalContext->pixelLayout;
+}
+
+void df_videoinfo2(
+	AV1_Context *context,
+	int *width,
+	int *height,
+	PixelLayout *pixelLayout,
+	uint8_t *hbd
+) {
+	Context *internalContext = (Context*) context;
+
+	*width = internalContext->width;
+	*height = internalContext->height;
+	*pixelLayout = internalContext->pixelLayout;
+	*hbd = internalContext->hbd;
+}
+
+int df_set_operating_point(AV1_Context *context, int32_t operatingPoint)
+{
+	if (operatingPoint < 0 || operatingPoint > 31)
+	{
+		return 0;
+	}
+
+	INTERNAL_atomicStore(&((Context*) context)->operatingPoint, (uint32_t) operatingPoint);
+	return 1;
+}
+
+void df_framesize(
+	AV1_Context *context,
+	int *width,
+	int *height,
+	int *renderWidth,
+	int *renderHeight
+) {
+	Context *internalContext = (Context*) context;
+	const Dav1dPicture *picture = &internalContext->currentPicture;
+
+	if (picture->data[0] == NULL)
+	{
+		*width = internalContext->width;
+		*height = internalContext->height;
+		*renderWidth = internalContext->width;
+		*renderHeight = internalContext->height;
+		return;
+	}
+
+	*width = picture->p.w;
+	*height = picture->p.h;
+	*renderWidth = picture->frame_hdr ? picture->frame_hdr->render_width : picture->p.w;
+	*renderHeight = picture->frame_hdr ? picture->frame_hdr->render_height : picture->p.h;
+}
+
+void df_set_render_crop(AV1_Context *context, uint8_t enabled)
+{
+	((Context*) context)->renderCrop = enabled != 0;
+}
+
+/* The index covers the source playing, which starts at frameBase and timeBase.
+ * Looping numbers frames on past the index, pass after pass. These take such
+ * frame numbers, with the index ready and not empty.
+ */
+static const FrameInfo* INTERNAL_indexEntry(Context *context, uint32_t frame)
+{
+	return &context->index[(frame - context->frameBase) % context->indexCount];
+}
+
+/* Ticks from the start of one pass to the start of the next, the feed clock
+ * carries on by the interval it had at the end
+ */
+static uint64_t INTERNAL_loopTicks(Context *context)
+{
+	const FrameInfo *last = &context->index[context->indexCount - 1];
+	uint64_t interval;
+
+	if (context->indexCount > 1)
+	{
+		interval = last[0].presentationTime - last[-1].presentationTime;
+	}
+	else if (context->equal_picture_interval && context->num_ticks_per_picture > 0)
+	{
+		interval = context->num_ticks_per_picture;
+	}
+	else
+	{
+		interval = 1;
+	}
+
+	return last->presentationTime + interval;
+}
+
+static uint64_t INTERNAL_indexTime(Context *context, uint32_t frame)
+{
+	uint32_t relative = frame - context->frameBase;
+	uint64_t time = context->timeBase + INTERNAL_indexEntry(context, frame)->presentationTime;
+
+	if (relative >= context->indexCount)
+	{
+		time += (relative / context->indexCount) * INTERNAL_loopTicks(context);
+	}
+	return time;
+}
+
+static void INTERNAL_getTiming(Context *context, const Dav1dPicture *picture, FrameTiming *timing)
+{
+	const Dav1dSequenceHeader *sequenceHeader = picture->seq_hdr;
+	double tick;
+
+	timing->frame = (uint32_t) picture->m.timestamp;
+	timing->presentationTime = (uint64_t) picture->m.offset;
+	timing->duration = (uint64_t) picture->m.duration;
+	timing->presentationSeconds = 0.0;
+	timing->durationSeconds = 0.0;
+	timing->source = TIMING_SOURCE_NONE;
+
+	/* The feed only knows the interval before a frame, the index knows the one after */
+	if (	!context->indexThreadRunning &&
+		context->indexState == INDEX_STATE_READY &&
+		context->indexCount > 0 &&
+		timing->frame >= context->frameBase &&
+		(timing->frame - context->frameBase + 1 < context->indexCount || INTERNAL_indexLoops(context))	)
+	{
+		timing->duration = INTERNAL_indexTime(context, timing->frame + 1) - INTERNAL_indexTime(context, timing->frame);
+	}
+
+	if (sequenceHeader == NULL || !sequenceHeader->timing_info_present || sequenceHeader->time_scale == 0)
+	{
+		return;
+	}
+
+	if (sequenceHeader->equal_picture_interval)
+	{
+		timing->source = TIMING_SOURCE_PICTURE_INTERVAL;
+	}
+	else if (sequenceHeader->decoder_model_info_present)
+	{
+		timing->source = TIMING_SOURCE_PRESENTATION_TIME;
+	}
+	else
+	{
+		return;
+	}
+
+	tick = (double) sequenceHeader->num_units_in_tick / sequenceHeader->time_scale;
+	timing->presentationSeconds = timing->presentationTime * tick;
+	timing->durationSeconds = timing->duration * tick;
+}
+
+int df_frametiming(AV1_Context *context, FrameTiming *timing)
+{
+	Context *internalContext = (Context*) context;
+
+	if (internalContext->currentPicture.data[0] == NULL)
+	{
+		return 0;
+	}
+
+	INTERNAL_getTiming(internalContext, &internalContext->currentPicture, timing);
+	return 1;
+}
+
+int df_guessframerate(
+	AV1_Context *context,
+	double *fps
+) {
+	Context *internalContext = (Context*) context;
+
+	// Note that most encoders do not set this information by default
+	if (internalContext->timing_info_present && internalContext->equal_picture_interval) {
+		*fps = (double)internalContext->time_scale / (internalContext->num_ticks_per_picture * internalContext->num_units_in_tick);
+		return 1;
+	}
+	else
+	{
+		return 0;
+	}
+}
+
+/* Decoding */
+
+// 1 = got a picture
+// 0 = end of stream
+// -1 = error
+static int INTERNAL_decodePicture(Context *context, Dav1dPicture *picture)
+{
+	int res, fed;
+
+	fed = 0;
+
+	for (;;)
+	{
+		for (;;)
+		{
+			if (context->pendingData.sz == 0 && (fed = df_INTERNAL_read_data(context, &context->pendingData)) != 1)
+			{
+				break;
+			}
+
+			res = dav1d_send_data(context->dav1dContext, &context->pendingData);
+			// Keep going even if the function can't consume the current data
+			//   packet. It eventually will after one or more frames have been
+			//   returned in this loop.
+			if (res < 0 && res != DAV1D_ERR(EAGAIN))
+			{
+				dav1d_data_unref(&context->pendingData);
+				return -1;
+			}
+
+			res = dav1d_get_picture(context->dav1dContext, picture);
+			if (res == 0)
+			{
+				return 1;
+			}
+			if (res != DAV1D_ERR(EAGAIN))
+			{
+				return -1;
+			}
+		}
+
+		// end of bitstream, keep decoding
+		res = dav1d_get_picture(context->dav1dContext, picture);
+		if (res == 0)
+		{
+			return 1;
+		}
+		if (res != DAV1D_ERR(EAGAIN))
+		{
+			return -1;
+		}
+
+		/* Drained. A read error shows once the pictures before it are out. */
+		if (fed < 0)
+		{
+			return -1;
+		}
+
+		/* A queued source that needs its own decoder can start */
+		if (!INTERNAL_nextDecoder(context))
+		{
+			return 0;
+		}
+	}
+}
+
+/* Same as INTERNAL_decodePicture, minus the pictures before skipToFrame */
+static int INTERNAL_decodeFrame(Context *context, Dav1dPicture *picture)
+{
+	Dav1dPicture grained;
+	int res;
+
+	while ((res = INTERNAL_decodePicture(context, picture)) == 1)
+	{
+		if ((uint64_t) picture->m.timestamp >= INTERNAL_atomicLoad(&context->skipToFrame))
+		{
+			/* Pictures without grain come back as another reference */
+			if (INTERNAL_atomicLoad(&context->applyGrain))
+			{
+				memset(&grained, '\0', sizeof(Dav1dPicture));
+				if (dav1d_apply_grain(context->dav1dContext, &grained, picture) < 0)
+				{
+					dav1d_picture_unref(picture);
+					return -1;
+				}
+				dav1d_picture_unref(picture);
+				*picture = grained;
+			}
+			return 1;
+		}
+
+		dav1d_picture_unref(picture);
+	}
+
+	return res;
+}
+
+/* Frame ring. The indices only ever count up, slots are index % capacity. */
+
+/* Decoded and not released yet, i.e. slots in use */
+static inline uint32_t INTERNAL_framesQueued(Context *context)
+{
+	return INTERNAL_atomicLoad(&context->frameWriteIndex) - INTERNAL_atomicLoad(&context->frameReleaseIndex);
+}
+
+/* Decoded and not handed to the reader yet */
+static inline uint32_t INTERNAL_framesReady(Context *context)
+{
+	return INTERNAL_atomicLoad(&context->frameWriteIndex) - context->frameAcquireIndex;
+}
+
+/* Producer side, only called with room in the ring */
+static void INTERNAL_pushFrame(Context *context, Dav1dPicture *picture)
+{
+	uint32_t writeIndex = context->frameWriteIndex;
+
+	context->frameQueue[writeIndex % context->frameQueueCapacity] = *picture;
+	INTERNAL_atomicStore(&context->frameWriteIndex, writeIndex + 1);
+}
+
+static Dav1dPicture* INTERNAL_acquireFrame(Context *context)
+{
+	Dav1dPicture *picture;
+
+	if (INTERNAL_framesReady(context) == 0)
+	{
+		return NULL;
+	}
+
+	picture = &context->frameQueue[context->frameAcquireIndex % context->frameQueueCapacity];
+	context->frameAcquireIndex += 1;
+
+	return picture;
+}
+
+/* Releases the oldest acquired frame.
+ * Returns 1 if the ring was full, so the producer may be waiting for room.
+ */
+static int INTERNAL_releaseFrame(Context *context)
+{
+	uint32_t releaseIndex = context->frameReleaseIndex;
+
+	dav1d_picture_unref(&context->frameQueue[releaseIndex % context->frameQueueCapacity]);
+	INTERNAL_atomicStore(&context->frameReleaseIndex, releaseIndex + 1);
+
+	/* Checked after the store, so either we see the producer's last frame or it sees our room */
+	return INTERNAL_atomicLoad(&context->frameWriteIndex) - (releaseIndex + 1) == context->frameQueueCapacity - 1;
+}
+
+/* Moves the next frame out of the ring, once the reader holds no acquired frames */
+static int INTERNAL_popFrame(Context *context, Dav1dPicture *picture)
+{
+	Dav1dPicture *slot;
+
+	if (context->frameAcquireIndex != context->frameReleaseIndex)
+	{
+		return 0;
+	}
+
+	slot = INTERNAL_acquireFrame(context);
+	if (slot == NULL)
+	{
+		return 0;
+	}
+
+	*picture = *slot;
+	memset(slot, '\0', sizeof(Dav1dPicture));
+	INTERNAL_releaseFrame(context);
+
+	return 1;
+}
+
+/* Only called while no worker can produce into the ring */
+static void INTERNAL_dropFrames(Context *context)
+{
+	while (context->frameReleaseIndex != context->frameWriteIndex)
+	{
+		dav1d_picture_unref(&context->frameQueue[context->frameReleaseIndex % context->frameQueueCapacity]);
+		context->frameReleaseIndex += 1;
+	}
+
+	context->frameWriteIndex = 0;
+	context->frameReleaseIndex = 0;
+	context->frameAcquireIndex = 0;
+}
+
+/* Pool */
+
+static int INTERNAL_isRunnable(Context *context)
+{
+	return	!context->decodeBusy &&
+		!context->decodePaused &&
+		context->decodeResult == 1 &&
+		INTERNAL_framesQueued(context) < context->frameQueueCapacity;
+}
+
+/* Picks the next context after the last one served that has room for another frame */
+static Context* INTERNAL_nextRunnable(Pool *pool)
+{
+	Context *start, *context;
+
+	if (pool->contexts == NULL)
+	{
+		return NULL;
+	}
+
+	start = (pool->cursor != NULL && pool->cursor->poolNext != NULL) ? pool->cursor->poolNext : pool->contexts;
+	context = start;
+
+	do
+	{
+		if (INTERNAL_isRunnable(context))
+		{
+			pool->cursor = context;
+			return context;
+		}
+
+		context = (context->poolNext != NULL) ? context->poolNext : pool->contexts;
+	} while (context != start);
+
+	return NULL;
+}
+
+static THREAD_RETURN INTERNAL_poolWorker(void *data)
+{
+	Pool *pool = (Pool*) data;
+	Context *context;
+	Dav1dPicture picture;
+	int result;
+
+	INTERNAL_mutexLock(&pool->lock);
+
+	while (!pool->shutdown)
+	{
+		context = INTERNAL_nextRunnable(pool);
+		if (context == NULL)
+		{
+			INTERNAL_conditionWait(&pool->workReady, &pool->lock);
+			continue;
+		}
+
+		/* One frame per turn, so every context gets its share */
+		context->decodeBusy = 1;
+		INTERNAL_mutexUnlock(&pool->lock);
+
+		memset(&picture, '\0', sizeof(Dav1dPicture));
+		result = INTERNAL_decodeFrame(context, &picture);
+		if (result == 1)
+		{
+			INTERNAL_pushFrame(context, &picture);
+		}
+
+		INTERNAL_mutexLock(&pool->lock);
+		context->decodeBusy = 0;
+		if (result != 1)
+		{
+			context->decodeResult = result;
+		}
+		INTERNAL_conditionBroadcast(&pool->frameReady);
+	}
+
+	INTERNAL_mutexUnlock(&pool->lock);
+
+	return 0;
+}
+
+int df_pool_create(int32_t threadCount, AV1_Pool **pool)
+{
+	Pool *internalPool;
+	int32_t i;
+
+	if (threadCount <= 0)
+	{
+		threadCount = INTERNAL_cpuCount();
+	}
+
+	internalPool = malloc(sizeof(Pool));
+	if (!internalPool)
+	{
+		return 0;
+	}
+
+	internalPool->threads = malloc(sizeof(Thread) * threadCount);
+	if (!internalPool->threads)
+	{
+		free(internalPool);
+		return 0;
+	}
+
+	INTERNAL_mutexInit(&internalPool->lock);
+	INTERNAL_conditionInit(&internalPool->workReady);
+	INTERNAL_conditionInit(&internalPool->frameReady);
+	internalPool->threadCount = 0;
+	internalPool->contexts = NULL;
+	internalPool->cursor = NULL;
+	internalPool->shutdown = 0;
+
+	for (i = 0; i < threadCount; i += 1)
+	{
+		if (!INTERNAL_threadCreate(&internalPool->threads[i], INTERNAL_poolWorker, internalPool))
+		{
+			df_pool_destroy((AV1_Pool*) internalPool);
+			return 0;
+		}
+		internalPool->threadCount += 1;
+	}
+
+	*pool = (AV1_Pool*) internalPool;
+	return 1;
+}
+
+void df_pool_destroy(AV1_Pool *pool)
+{
+	Pool *internalPool = (Pool*) pool;
+	Context *context;
+	int32_t i;
+
+	INTERNAL_mutexLock(&internalPool->lock);
+	internalPool->shutdown = 1;
+	INTERNAL_conditionBroadcast(&internalPool->workReady);
+	INTERNAL_mutexUnlock(&internalPool->lock);
+
+	for (i = 0; i < internalPool->threadCount; i += 1)
+	{
+		INTERNAL_threadJoin(internalPool->threads[i]);
+	}
+
+	/* Anything still attached goes back to decoding on the caller's thread */
+	for (context = internalPool->contexts; context != NULL; context = context->poolNext)
+	{
+		context->pool = NULL;
+	}
+
+	INTERNAL_conditionDestroy(&internalPool->frameReady);
+	INTERNAL_conditionDestroy(&internalPool->workReady);
+	INTERNAL_mutexDestroy(&internalPool->lock);
+	free(internalPool->threads);
+	free(internalPool);
+}
+
+/* Waits for the worker (if any) to let go of the context and keeps the others away */
+static void INTERNAL_pauseDecoding(Context *context)
+{
+	Pool *pool = context->pool;
+
+	if (pool == NULL)
+	{
+		return;
+	}
+
+	INTERNAL_mutexLock(&pool->lock);
+	context->decodePaused = 1;
+	while (context->decodeBusy)
+	{
+		INTERNAL_conditionWait(&pool->frameReady, &pool->lock);
+	}
+	INTERNAL_mutexUnlock(&pool->lock);
+}
+
+static void INTERNAL_resumeDecoding(Context *context)
+{
+	Pool *pool = context->pool;
+
+	if (pool == NULL)
+	{
+		return;
+	}
+
+	INTERNAL_mutexLock(&pool->lock);
+	context->decodePaused = 0;
+	INTERNAL_conditionSignal(&pool->workReady);
+	INTERNAL_mutexUnlock(&pool->lock);
+}
+
+static void INTERNAL_detach(Context *context)
+{
+	Pool *pool = context->pool;
+	Context **link;
+
+	if (pool == NULL)
+	{
+		return;
+	}
+
+	INTERNAL_pauseDecoding(context);
+
+	INTERNAL_mutexLock(&pool->lock);
+	for (link = &pool->contexts; *link != NULL; link = &(*link)->poolNext)
+	{
+		if (*link == context)
+		{
+			*link = context->poolNext;
+			break;
+		}
+	}
+	if (pool->cursor == context)
+	{
+		pool->cursor = NULL;
+	}
+	INTERNAL_mutexUnlock(&pool->lock);
+
+	context->pool = NULL;
+	context->poolNext = NULL;
+
+	if (context->ownsPool)
+	{
+		df_pool_destroy((AV1_Pool*) pool);
+		context->ownsPool = 0;
+	}
+}
+
+/* Moves the read position back to the start of the stream, or of the source playing */
+static void INTERNAL_rewind(Context *context)
+{
+	INTERNAL_rollbackFeed(context);
+
+	context->bitstreamIndex = 0;
+	context->currentOBUSize = 0;
+	context->releasedIndex = 0;
+	context->feedFrame = context->frameBase;
+	context->feedShown = 0;
+	context->feedDropping = 0;
+	INTERNAL_resetClock(&context->feedClock, context->timeBase, 1);
+	context->nextFrame = context->frameBase;
+	INTERNAL_atomicStore(&context->skipToFrame, context->frameBase); /* a catch-up target is stale now */
+	context->eof = 0;
+
+	/* The start of the stream may have slid out of the window already */
+	if (context->readFunc != NULL && context->streamOffset != 0)
+	{
+		if (context->seekFunc != NULL && context->seekFunc(context->userdata, 0))
+		{
+			context->bitstreamDataSize = 0;
+			context->streamOffset = 0;
+			context->streamEnd = 0;
+		}
+		else
+		{
+			/* No way back, stay at the end of the stream */
+			context->bitstreamIndex = context->bitstreamDataSize;
+			context->streamEnd = 1;
+			context->eof = 1;
+		}
+	}
+
+	if (context->mapped)
+	{
+		INTERNAL_adviseWillNeed(context->bitstreamData, context->bitstreamDataSize);
+	}
+}
+
+static int INTERNAL_attach(Pool *pool, Context *context, int32_t framesAhead)
+{
+	Dav1dPicture *frameQueue;
+
+	if (framesAhead <= 0)
+	{
+		framesAhead = DEFAULT_FRAMES_AHEAD;
+	}
+	else if (framesAhead > MAX_FRAMES_AHEAD)
+	{
+		framesAhead = MAX_FRAMES_AHEAD;
+	}
+
+	INTERNAL_dropFrames(context);
+
+	frameQueue = realloc(context->frameQueue, sizeof(Dav1dPicture) * framesAhead);
+	if (!frameQueue)
+	{
+		return 0;
+	}
+
+	context->frameQueue = frameQueue;
+	context->frameQueueCapacity = (uint32_t) framesAhead;
+	context->decodeResult = 1;
+	context->decodePaused = 0;
+
+	INTERNAL_mutexLock(&pool->lock);
+	context->pool = pool;
+	context->poolNext = pool->contexts;
+	pool->contexts = context;
+	INTERNAL_conditionSignal(&pool->workReady);
+	INTERNAL_mutexUnlock(&pool->lock);
+
+	return 1;
+}
+
+int df_pool_attach(AV1_Pool *pool, AV1_Context *context, int32_t framesAhead)
+{
+	Context *internalContext = (Context*) context;
+	DecoderSettings settings;
+	Dav1dContext *dav1dContext;
+
+	if (internalContext->pool != NULL)
+	{
+		return 0;
+	}
+
+	/* The pool's workers are the only threads, so dav1d runs on whichever one picks this up */
+	settings = internalContext->settings;
+	settings.threadCount = 1;
+	settings.maxFrameDelay = 1;
+
+	dav1dContext = NULL;
+	if (!INTERNAL_openDecoder(&settings, internalContext->allocator, &dav1dContext))
+	{
+		return 0;
+	}
+
+	INTERNAL_dropFrames(internalContext);
+	dav1d_picture_unref(&internalContext->currentPicture);
+	dav1d_data_unref(&internalContext->pendingData);
+	dav1d_close(&internalContext->dav1dContext);
+
+	internalContext->dav1dContext = dav1dContext;
+	internalContext->settings = settings;
+	INTERNAL_rewind(internalContext);
+
+	return INTERNAL_attach((Pool*) pool, internalContext, framesAhead);
+}
+
+int df_start_async(AV1_Context *context, int32_t framesAhead)
+{
+	Context *internalContext = (Context*) context;
+	AV1_Pool *pool;
+
+	if (internalContext->pool != NULL)
+	{
+		return 0;
+	}
+
+	/* A pool of one, the decoder keeps its own threads and position */
+	if (!df_pool_create(1, &pool))
+	{
+		return 0;
+	}
+
+	if (!INTERNAL_attach((Pool*) pool, internalContext, framesAhead))
+	{
+		df_pool_destroy(pool);
+		return 0;
+	}
+
+	internalContext->ownsPool = 1;
+	return 1;
+}
+
+static int INTERNAL_nextPicture(Context *context, Dav1dPicture *picture)
+{
+	Pool *pool = context->pool;
+	int result;
+
+	if (pool == NULL)
+	{
+		/* Frames left over from a destroyed pool come first */
+		if (INTERNAL_framesReady(context) > 0)
+		{
+			return INTERNAL_popFrame(context, picture) ? 1 : -1;
+		}
+
+		return INTERNAL_decodeFrame(context, picture);
+	}
+
+	INTERNAL_mutexLock(&pool->lock);
+
+	while (INTERNAL_framesReady(context) == 0 && context->decodeResult == 1)
+	{
+		INTERNAL_conditionWait(&pool->frameReady, &pool->lock);
+	}
+
+	if (INTERNAL_framesReady(context) > 0)
+	{
+		result = INTERNAL_popFrame(context, picture) ? 1 : -1;
+		INTERNAL_conditionSignal(&pool->workReady);
+	}
+	else
+	{
+		result = context->decodeResult;
+	}
+
+	INTERNAL_mutexUnlock(&pool->lock);
+
+	return result;
+}
+
+static void INTERNAL_getPlanes(
+	const Dav1dPicture *picture,
+	void **yData,
+	void **uData,
+	void **vData,
+	uint32_t *yDataLength,
+	uint32_t *uvDataLength,
+	uint32_t *yStride,
+	uint32_t *uvStride
+) {
+	/* Set the picture data pointers */
+	*yData = picture->data[0];
+	*uData = picture->data[1];
+	*vData = picture->data[2];
+	*yStride = picture->stride[0];
+	*uvStride = picture->stride[1];
+
+	const int ss_ver = picture->p.layout == DAV1D_PIXEL_LAYOUT_I420;
+	const int aligned_h = (picture->p.h + 127) & ~127;
+	*yDataLength = *yStride * aligned_h;
+	*uvDataLength = *uvStride * (aligned_h >> ss_ver);
+}
+
+int df_acquire_frame(
+	AV1_Context *context,
+	void **yData,
+	void **uData,
+	void **vData,
+	uint32_t *yDataLength,
+	uint32_t *uvDataLength,
+	uint32_t *yStride,
+	uint32_t *uvStride
+) {
+	Context *internalContext = (Context*) context;
+	Pool *pool = internalContext->pool;
+	Dav1dPicture *picture;
+	Dav1dPicture decoded;
+	int result;
+
+	if (internalContext->frameQueueCapacity == 0)
+	{
+		return 0;
+	}
+
+	picture = INTERNAL_acquireFrame(internalContext);
+
+	if (picture == NULL && pool != NULL)
+	{
+		/* Workers only hold the lock for bookkeeping, never across a decode */
+		INTERNAL_mutexLock(&pool->lock);
+		result = internalContext->decodeResult;
+		INTERNAL_mutexUnlock(&pool->lock);
+
+		/* The last frame is queued before the decode result is set */
+		if (result != 1 && INTERNAL_framesReady(internalContext) == 0)
+		{
+			if (result < 0)
+			{
+				return -1;
+			}
+			internalContext->eof = 1;
+		}
+	}
+	else if (picture == NULL && INTERNAL_framesQueued(internalContext) < internalContext->frameQueueCapacity)
+	{
+		/* The pool was destroyed, decode on the caller's thread */
+		memset(&decoded, '\0', sizeof(Dav1dPicture));
+		result = INTERNAL_decodeFrame(internalContext, &decoded);
+		if (result == 1)
+		{
+			INTERNAL_pushFrame(internalContext, &decoded);
+			picture = INTERNAL_acquireFrame(internalContext);
+		}
+		else if (result < 0)
+		{
+			return -1;
+		}
+		else
+		{
+			internalContext->eof = 1;
+		}
+	}
+
+	if (picture == NULL)
+	{
+		return 0;
+	}
+
+	internalContext->nextFrame = (uint32_t) picture->m.timestamp + 1;
+	INTERNAL_followSource(internalContext, (uint32_t) picture->m.timestamp);
+
+	INTERNAL_getPlanes(picture, yData, uData, vData, yDataLength, uvDataLength, yStride, uvStride);
+	return 1;
+}
+
+void df_release_frame(AV1_Context *context)
+{
+	Context *internalContext = (Context*) context;
+	Pool *pool = internalContext->pool;
+
+	if (internalContext->frameAcquireIndex == internalContext->frameReleaseIndex)
+	{
+		return;
+	}
+
+	if (INTERNAL_releaseFrame(internalContext) && pool != NULL)
+	{
+		INTERNAL_mutexLock(&pool->lock);
+		INTERNAL_conditionSignal(&pool->workReady);
+		INTERNAL_mutexUnlock(&pool->lock);
+	}
+}
+
+/* Index */
+
+static int INTERNAL_buildIndex(Context *context)
+{
+	HeaderParser *parser;
+	OBUInfo *info;
+	OBPFrameHeader *frameHeader;
+	PresentationClock clock;
+	FrameInfo *index, *entry, *grown;
+	uint8_t *bitstreamData;
+	uint32_t count, capacity;
+	size_t bitstreamDataSize, position;
+	uint8_t hasTemporalDelimiters, shown, firstFrame;
+
+	parser = calloc(1, sizeof(HeaderParser));
+	info = malloc(sizeof(OBUInfo));
+	capacity = 1024;
+	index = malloc(sizeof(FrameInfo) * capacity);
+	if (!parser || !info || !index)
+	{
+		free(parser);
+		free(info);
+		free(index);
+		return 0;
+	}
+
+	count = 0;
+	entry = NULL;
+	position = 0;
+	hasTemporalDelimiters = 0;
+	shown = 0;
+	firstFrame = 1;
+	INTERNAL_resetClock(&clock, 0, 1);
+	INTERNAL_playingBitstream(context, &bitstreamData, &bitstreamDataSize);
+
+	while (position < bitstreamDataSize)
+	{
+		/* Trailing garbage ends the index, just like it ends decoding */
+		if (!INTERNAL_inspectOBU(parser, bitstreamData + position, bitstreamDataSize - position, info))
+		{
+			break;
+		}
+
+		if (info->type == OBP_OBU_TEMPORAL_DELIMITER)
+		{
+			hasTemporalDelimiters = 1;
+		}
+
+		/* A temporal unit ends at the next delimiter. Without delimiters, at the next
+		 * frame after a shown one. Units without a shown frame merge into the next.
+		 */
+		if (	entry == NULL ||
+			(shown && info->type == OBP_OBU_TEMPORAL_DELIMITER) ||
+			(shown && !hasTemporalDelimiters && info->hasFrameHeader)	)
+		{
+			if (count == capacity)
+			{
+				grown = (capacity <= UINT32_MAX / 2) ? realloc(index, sizeof(FrameInfo) * capacity * 2) : NULL;
+				if (!grown)
+				{
+					free(parser);
+					free(info);
+					free(index);
+					return 0;
+				}
+				index = grown;
+				capacity *= 2;
+			}
+
+			entry = &index[count];
+			count += 1;
+			memset(entry, '\0', sizeof(FrameInfo));
+			entry->offset = position;
+			shown = 0;
+			firstFrame = 1;
+		}
+
+		if (info->hasFrameHeader)
+		{
+			frameHeader = &info->frameHeader;
+
+			if (firstFrame)
+			{
+				entry->keyFrame =
+					!frameHeader->show_existing_frame &&
+					frameHeader->show_frame &&
+					frameHeader->frame_type == OBP_KEY_FRAME;
+				firstFrame = 0;
+			}
+
+			entry->refreshFrameFlags |= frameHeader->refresh_frame_flags;
+
+			if (!shown && (frameHeader->show_frame || frameHeader->show_existing_frame))
+			{
+				entry->frameType = (FrameType) frameHeader->frame_type;
+				entry->showExistingFrame = (uint8_t) frameHeader->show_existing_frame;
+				INTERNAL_advanceClock(&clock, parser, frameHeader);
+				entry->presentationTime = clock.time;
+				shown = 1;
+			}
+		}
+
+		position += info->size;
+		entry->size = (uint32_t) (position - entry->offset);
+	}
+
+	/* Leftovers without a shown frame are not a frame */
+	if (entry != NULL && !shown)
+	{
+		count -= 1;
+	}
+
+	free(parser);
+	free(info);
+
+	context->index = index;
+	context->indexCount = count;
+	return 1;
+}
+
+static THREAD_RETURN INTERNAL_indexWorker(void *data)
+{
+	Context *context = (Context*) data;
+
+	context->indexState = INTERNAL_buildIndex(context) ? INDEX_STATE_READY : INDEX_STATE_FAILED;
+
+	return 0;
+}
+
+int df_build_index(AV1_Context *context, uint8_t background)
+{
+	Context *internalContext = (Context*) context;
+
+	/* Indexing a stream would mean reading all of it up front */
+	if (internalContext->readFunc != NULL)
+	{
+		return 0;
+	}
+
+	if (internalContext->indexThreadRunning)
+	{
+		if (background)
+		{
+			return 1;
+		}
+		INTERNAL_waitForIndex(internalContext);
+	}
+
+	if (internalContext->indexState == INDEX_STATE_READY)
+	{
+		return 1;
+	}
+
+	internalContext->indexState = INDEX_STATE_BUILDING;
+
+	if (background && INTERNAL_threadCreate(&internalContext->indexThread, INTERNAL_indexWorker, internalContext))
+	{
+		internalContext->indexThreadRunning = 1;
+		return 1;
+	}
+
+	INTERNAL_indexWorker(internalContext);
+	return internalContext->indexState == INDEX_STATE_READY;
+}
+
+int df_frame_count(AV1_Context *context, uint32_t *count)
+{
+	Context *internalContext = (Context*) context;
+
+	if (!df_build_index(context, 0))
+	{
+		return 0;
+	}
+
+	*count = internalContext->indexCount;
+	return 1;
+}
+
+int df_frame_info(AV1_Context *context, uint32_t frame, FrameInfo *info)
+{
+	Context *internalContext = (Context*) context;
+
+	if (!df_build_index(context, 0) || frame >= internalContext->indexCount)
+	{
+		return 0;
+	}
+
+	*info = internalContext->index[frame];
+	return 1;
+}
+
+int df_write_index(AV1_Context *context, const char *fname)
+{
+	Context *internalContext = (Context*) context;
+	FILE *file;
+	uint8_t *buffer, *dst, *bitstreamData;
+	size_t size, bitstreamDataSize, sequenceHeaderOffset, sequenceHeaderSize;
+	uint32_t i;
+	int result;
+
+	if (!df_build_index(context, 0))
+	{
+		return 0;
+	}
+
+	INTERNAL_playingBitstream(internalContext, &bitstreamData, &bitstreamDataSize);
+	if (internalContext->playing != NULL)
+	{
+		sequenceHeaderOffset = internalContext->playing->sequenceHeaderOffset;
+		sequenceHeaderSize = internalContext->playing->sequenceHeaderSize;
+	}
+	else
+	{
+		sequenceHeaderOffset = internalContext->sequenceHeaderOffset;
+		sequenceHeaderSize = internalContext->sequenceHeaderSize;
+	}
+
+	size = INDEX_FILE_HEADER_SIZE + (size_t) internalContext->indexCount * INDEX_FILE_ENTRY_SIZE;
+	buffer = calloc(1, size);
+	if (!buffer)
+	{
+		return 0;
+	}
+
+	memcpy(buffer, "DFIX", 4);
+	INTERNAL_writeU32(buffer + 4, INDEX_FILE_VERSION);
+	INTERNAL_writeU64(buffer + 8, bitstreamDataSize);
+	INTERNAL_writeU64(buffer + 16, INTERNAL_hashBitstream(bitstreamData, bitstreamDataSize));
+	INTERNAL_writeU32(buffer + 24, (uint32_t) internalContext->width);
+	INTERNAL_writeU32(buffer + 28, (uint32_t) internalContext->height);
+	buffer[32] = (uint8_t) internalContext->pixelLayout;
+	buffer[33] = internalContext->hbd;
+	buffer[34] = internalContext->timing_info_present;
+	buffer[35] = internalContext->equal_picture_interval;
+	INTERNAL_writeU32(buffer + 36, internalContext->num_units_in_tick);
+	INTERNAL_writeU32(buffer + 40, internalContext->time_scale);
+	INTERNAL_writeU32(buffer + 44, internalContext->num_ticks_per_picture);
+	INTERNAL_writeU64(buffer + 48, sequenceHeaderOffset);
+	INTERNAL_writeU64(buffer + 56, sequenceHeaderSize);
+	INTERNAL_writeU32(buffer + 64, internalContext->indexCount);
+
+	for (i = 0; i < internalContext->indexCount; i += 1)
+	{
+		dst = buffer + INDEX_FILE_HEADER_SIZE + (size_t) i * INDEX_FILE_ENTRY_SIZE;
+		INTERNAL_writeU64(dst, internalContext->index[i].offset);
+		INTERNAL_writeU32(dst + 8, internalContext->index[i].size);
+		dst[12] = (uint8_t) internalContext->index[i].frameType;
+		dst[13] = internalContext->index[i].keyFrame;
+		dst[14] = internalContext->index[i].showExistingFrame;
+		dst[15] = internalContext->index[i].refreshFrameFlags;
+		INTERNAL_writeU64(dst + 16, internalContext->index[i].presentationTime);
+	}
+
+	file = fopen(fname, "wb");
+	if (!file)
+	{
+		free(buffer);
+		return 0;
+	}
+
+	result = fwrite(buffer, 1, size, file) == size;
+	result = (fclose(file) == 0) && result;
+	free(buffer);
+
+	return result;
+}
+
+int df_load_index(AV1_Context *context, const char *fname)
+{
+	Context *internalContext = (Context*) context;
+	IndexFile indexFile;
+	uint8_t *bitstreamData;
+	size_t bitstreamDataSize;
+
+	if (internalContext->readFunc != NULL || !INTERNAL_readIndexFile(fname, &indexFile))
+	{
+		return 0;
+	}
+
+	INTERNAL_playingBitstream(internalContext, &bitstreamData, &bitstreamDataSize);
+	if (!INTERNAL_checkIndexFile(&indexFile, bitstreamData, bitstreamDataSize))
+	{
+		free(indexFile.entries);
+		return 0;
+	}
+
+	INTERNAL_waitForIndex(internalContext);
+	free(internalContext->index);
+	internalContext->index = indexFile.entries;
+	internalContext->indexCount = indexFile.count;
+	internalContext->indexState = INDEX_STATE_READY;
+
+	return 1;
+}
+
+/* Leaves the numFrames-th next picture in picture, which is unreferenced first */
+static int INTERNAL_readPicture(Context *context, int numFrames, Dav1dPicture *picture)
+{
+	uint32_t target;
+	int res;
+
+	/* Catching up, the frames in between don't need to be decoded unless
+	 * something references them
+	 */
+	target = context->nextFrame + (uint32_t) numFrames - 1;
+	if (numFrames > 1 && target > INTERNAL_atomicLoad(&context->skipToFrame))
+	{
+		INTERNAL_atomicStore(&context->skipToFrame, target);
+	}
+
+	for (int i = 0; i < numFrames; i += 1)
+	{
+		dav1d_picture_unref(picture);
+
+		res = INTERNAL_nextPicture(context, picture);
+		if (res <= 0)
+		{
+			if (res == 0)
+			{
+				context->eof = 1;
+			}
+			return 0;
+		}
+
+		context->nextFrame = (uint32_t) picture->m.timestamp + 1;
+		INTERNAL_followSource(context, (uint32_t) picture->m.timestamp);
+
+		/* Skipped frames never come out, so the target can come early */
+		if (context->nextFrame > target)
+		{
+			break;
+		}
+	}
+
+	return 1;
+}
+
+int df_readvideo(
+	AV1_Context *context,
+	int numFrames,
+	void **yData,
+	void **uData,
+	void **vData,
+	uint32_t *yDataLength,
+	uint32_t *uvDataLength,
+	uint32_t *yStride,
+	uint32_t *uvStride
+) {
+	Context *internalContext = (Context*) context;
+
+	if (!INTERNAL_readPicture(internalContext, numFrames, &internalContext->currentPicture))
+	{
+		return 0;
+	}
+
+	INTERNAL_getPlanes(
+		&internalContext->currentPicture,
+		yData,
+		uData,
+		vData,
+		yDataLength,
+		uvDataLength,
+		yStride,
+		uvStride
+	);
+
+	return 1;
+}
+
+/* Frame handles */
+
+int df_read_frame(AV1_Context *context, int numFrames, AV1_Frame **frame)
+{
+	Frame *result;
+
+	if (numFrames <= 0)
+	{
+		return 0;
+	}
+
+	result = calloc(1, sizeof(Frame));
+	if (!result)
+	{
+		return 0;
+	}
+
+	if (!INTERNAL_readPicture((Context*) context, numFrames, &result->picture))
+	{
+		free(result);
+		return 0;
+	}
+	INTERNAL_getTiming((Context*) context, &result->picture, &result->timing);
+
+	result->refCount = 1;
+	*frame = (AV1_Frame*) result;
+	return 1;
+}
+
+void df_frame_ref(AV1_Frame *frame)
+{
+	INTERNAL_atomicIncrement(&((Frame*) frame)->refCount);
+}
+
+void df_frame_unref(AV1_Frame *frame)
+{
+	Frame *internalFrame = (Frame*) frame;
+
+	if (internalFrame == NULL)
+	{
+		return;
+	}
+
+	if (INTERNAL_atomicDecrement(&internalFrame->refCount) == 0)
+	{
+		dav1d_picture_unref(&internalFrame->picture);
+		free(internalFrame);
+	}
+}
+
+void df_frame_planes(
+	AV1_Frame *frame,
+	void **yData,
+	void **uData,
+	void **vData,
+	uint32_t *yDataLength,
+	uint32_t *uvDataLength,
+	uint32_t *yStride,
+	uint32_t *uvStride
+) {
+	INTERNAL_getPlanes(
+		&((Frame*) frame)->picture,
+		yData,
+		uData,
+		vData,
+		yDataLength,
+		uvDataLength,
+		yStride,
+		uvStride
+	);
+}
+
+void df_frame_videoinfo(AV1_Frame *frame, int *width, int *height, PixelLayout *pixelLayout, uint8_t *hbd)
+{
+	Dav1dPicture *picture = &((Frame*) frame)->picture;
+
+	*width = picture->p.w;
+	*height = picture->p.h;
+	*pixelLayout = (PixelLayout) picture->p.layout;
+	*hbd = (uint8_t) ((picture->p.bpc - 8) >> 1);
+}
+
+void df_frame_timing(AV1_Frame *frame, FrameTiming *timing)
+{
+	*timing = ((Frame*) frame)->timing;
+}
+
+/* The current picture as the output functions see it, cut down to the render
+ * size when asked. Only the size changes, the planes are shared.
+ */
+static void INTERNAL_outputView(Context *context, Dav1dPicture *view)
+{
+	const Dav1dFrameHeader *frameHeader = context->currentPicture.frame_hdr;
+
+	*view = context->currentPicture;
+
+	if (context->renderCrop && frameHeader != NULL)
+	{
+		if (frameHeader->render_width > 0 && frameHeader->render_width < view->p.w)
+		{
+			view->p.w = frameHeader->render_width;
+		}
+		if (frameHeader->render_height > 0 && frameHeader->render_height < view->p.h)
+		{
+			view->p.h = frameHeader->render_height;
+		}
+	}
+}
+
+/* Conversion scratch has room for 4 * width 16 bit samples */
+static int INTERNAL_growScratch(Context *context, int32_t width)
+{
+	uint16_t *grown;
+
+	if (context->convertScratchWidth < width)
+	{
+		grown = realloc(context->convertScratch, sizeof(uint16_t) * 4 * width);
+		if (!grown)
+		{
+			return 0;
+		}
+		context->convertScratch = grown;
+		context->convertScratchWidth = width;
+	}
+
+	return 1;
+}
+
+/* RGBA output */
+
+/* Created by the first context that needs it, destroyed with the last one */
+static Mutex converterLock = MUTEX_INITIALIZER;
+static Converter *sharedConverter = NULL;
+
+/* Hands out the next band of job. The converter lock is held. */
+static int32_t INTERNAL_takeBand(Converter *converter, ConvertJob *job)
+{
+	ConvertJob **link;
+	int32_t band;
+
+	band = job->nextBand;
+	job->nextBand += 1;
+
+	if (job->nextBand == job->bandCount)
+	{
+		link = &converter->jobs;
+		while (*link != job)
+		{
+			link = &(*link)->next;
+		}
+		*link = job->next;
+	}
+
+	return band;
+}
+
+/* Without scratch the band is given up on */
+static void INTERNAL_convertBand(const ConvertJob *job, int32_t band, uint16_t *scratch)
+{
+	int32_t rowStart, rowEnd;
+
+	rowStart = band * CONVERT_BAND_ROWS;
+	rowEnd = rowStart + CONVERT_BAND_ROWS;
+	if (rowEnd > job->height)
+	{
+		rowEnd = job->height;
+	}
+
+	if (scratch != NULL)
+	{
+		df_INTERNAL_convertRGBA(
+			job->conversion,
+			job->rowFunc,
+			&job->picture,
+			job->rgba,
+			job->stride,
+			rowStart,
+			rowEnd,
+			scratch
+		);
+	}
+}
+
+/* The converter lock is held */
+static void INTERNAL_finishBand(Converter *converter, ConvertJob *job, uint8_t failed)
+{
+	job->failed |= failed;
+	job->bandsLeft -= 1;
+	if (job->bandsLeft == 0)
+	{
+		INTERNAL_conditionBroadcast(&converter->workDone);
+	}
+}
+
+static THREAD_RETURN INTERNAL_converterWorker(void *data)
+{
+	Converter *converter = (Converter*) data;
+	ConvertJob *job;
+	uint16_t *scratch, *grown;
+	int32_t scratchWidth, band;
+	uint8_t fits;
+
+	scratch = NULL;
+	scratchWidth = 0;
+
+	INTERNAL_mutexLock(&converter->lock);
+
+	while (!converter->shutdown)
+	{
+		job = converter->jobs;
+		if (job == NULL)
+		{
+			INTERNAL_conditionWait(&converter->workReady, &converter->lock);
+			continue;
+		}
+
+		/* Scratch is checked against the job the band is taken from, while
+		 * nothing can take its place
+		 */
+		if (scratchWidth < job->width)
+		{
+			grown = realloc(scratch, sizeof(uint16_t) * 4 * job->width);
+			if (grown)
+			{
+				scratch = grown;
+				scratchWidth = job->width;
+			}
+		}
+		fits = scratchWidth >= job->width;
+		band = INTERNAL_takeBand(converter, job);
+
+		INTERNAL_mutexUnlock(&converter->lock);
+		INTERNAL_convertBand(job, band, fits ? scratch : NULL);
+		INTERNAL_mutexLock(&converter->lock);
+
+		INTERNAL_finishBand(converter, job, !fits);
+	}
+
+	INTERNAL_mutexUnlock(&converter->lock);
+
+	free(scratch);
+	return 0;
+}
+
+static void INTERNAL_destroyConverter(Converter *converter)
+{
+	int32_t i;
+
+	INTERNAL_mutexLock(&converter->lock);
+	converter->shutdown = 1;
+	INTERNAL_conditionBroadcast(&converter->workReady);
+	INTERNAL_mutexUnlock(&converter->lock);
+
+	for (i = 0; i < converter->threadCount; i += 1)
+	{
+		INTERNAL_threadJoin(converter->threads[i]);
+	}
+
+	INTERNAL_conditionDestroy(&converter->workReady);
+	INTERNAL_conditionDestroy(&converter->workDone);
+	INTERNAL_mutexDestroy(&converter->lock);
+	free(converter->threads);
+	free(converter);
+}
+
+static Converter* INTERNAL_createConverter(void)
+{
+	Converter *converter;
+	int32_t threadCount, i;
+
+	/* The caller converts too */
+	threadCount = INTERNAL_cpuCount();
+	if (threadCount > CONVERT_MAX_THREADS)
+	{
+		threadCount = CONVERT_MAX_THREADS;
+	}
+	threadCount -= 1;
+
+	if (threadCount <= 0)
+	{
+		return NULL;
+	}
+
+	converter = malloc(sizeof(Converter));
+	if (!converter)
+	{
+		return NULL;
+	}
+
+	converter->threads = malloc(sizeof(Thread) * threadCount);
+	if (!converter->threads)
+	{
+		free(converter);
+		return NULL;
+	}
+
+	INTERNAL_mutexInit(&converter->lock);
+	INTERNAL_conditionInit(&converter->workReady);
+	INTERNAL_conditionInit(&converter->workDone);
+	converter->threadCount = 0;
+	converter->shutdown = 0;
+	converter->users = 0;
+	converter->jobs = NULL;
+
+	for (i = 0; i < threadCount; i += 1)
+	{
+		if (!INTERNAL_threadCreate(&converter->threads[i], INTERNAL_converterWorker, converter))
+		{
+			break;
+		}
+		converter->threadCount += 1;
+	}
+
+	if (converter->threadCount == 0)
+	{
+		INTERNAL_destroyConverter(converter);
+		return NULL;
+	}
+
+	return converter;
+}
+
+static Converter* INTERNAL_acquireConverter(void)
+{
+	Converter *converter;
+
+	INTERNAL_mutexLock(&converterLock);
+	if (sharedConverter == NULL)
+	{
+		sharedConverter = INTERNAL_createConverter();
+	}
+	converter = sharedConverter;
+	if (converter != NULL)
+	{
+		converter->users += 1;
+	}
+	INTERNAL_mutexUnlock(&converterLock);
+
+	return converter;
+}
+
+static void INTERNAL_releaseConverter(Converter *converter)
+{
+	uint8_t last;
+
+	INTERNAL_mutexLock(&converterLock);
+	converter->users -= 1;
+	last = converter->users == 0;
+	if (last)
+	{
+		sharedConverter = NULL;
+	}
+	INTERNAL_mutexUnlock(&converterLock);
+
+	if (last)
+	{
+		INTERNAL_destroyConverter(converter);
+	}
+}
+
+static int INTERNAL_convertPicture(
+	Context *context,
+	const Dav1dPicture *picture,
+	uint8_t *rgba,
+	uint32_t stride,
+	RGBAFormat format
+) {
+	Converter *converter;
+	RGBAConversion conversion;
+	ConvertJob job, **link;
+	int32_t band;
+	int result;
+
+	if (picture->data[0] == NULL || rgba == NULL || stride < (uint32_t) picture->p.w * 4)
+	{
+		return 0;
+	}
+
+	if (!INTERNAL_growScratch(context, picture->p.w))
+	{
+		return 0;
+	}
+
+	if (context->rgbaRowFunc == NULL)
+	{
+		context->rgbaRowFunc = df_INTERNAL_rgbaRowFunc();
+	}
+
+	df_INTERNAL_setupRGBA(picture, format, &conversion);
+
+	if ((int64_t) picture->p.w * picture->p.h < CONVERT_PARALLEL_PIXELS)
+	{
+		df_INTERNAL_convertRGBA(
+			&conversion,
+			context->rgbaRowFunc,
+			picture,
+			rgba,
+			stride,
+			0,
+			picture->p.h,
+			context->convertScratch
+		);
+		return 1;
+	}
+
+	if (context->converter == NULL)
+	{
+		context->converter = INTERNAL_acquireConverter();
+	}
+	converter = context->converter;
+
+	if (converter == NULL)
+	{
+		/* Single core, or no threads to be had */
+		df_INTERNAL_convertRGBA(
+			&conversion,
+			context->rgbaRowFunc,
+			picture,
+			rgba,
+			stride,
+			0,
+			picture->p.h,
+			context->convertScratch
+		);
+		return 1;
+	}
+
+	job.next = NULL;
+	job.conversion = &conversion;
+	job.rowFunc = context->rgbaRowFunc;
+	job.picture = *picture;
+	job.rgba = rgba;
+	job.stride = stride;
+	job.width = picture->p.w;
+	job.height = picture->p.h;
+	job.bandCount = (job.height + CONVERT_BAND_ROWS - 1) / CONVERT_BAND_ROWS;
+	job.nextBand = 0;
+	job.bandsLeft = job.bandCount;
+	job.failed = 0;
+
+	INTERNAL_mutexLock(&converter->lock);
+
+	link = &converter->jobs;
+	while (*link != NULL)
+	{
+		link = &(*link)->next;
+	}
+	*link = &job;
+	INTERNAL_conditionBroadcast(&converter->workReady);
+
+	/* Other contexts' jobs may be ahead, this thread only works on its own */
+	while (job.nextBand < job.bandCount)
+	{
+		band = INTERNAL_takeBand(converter, &job);
+		INTERNAL_mutexUnlock(&converter->lock);
+		INTERNAL_convertBand(&job, band, context->convertScratch);
+		INTERNAL_mutexLock(&converter->lock);
+		INTERNAL_finishBand(converter, &job, 0);
+	}
+
+	while (job.bandsLeft > 0)
+	{
+		INTERNAL_conditionWait(&converter->workDone, &converter->lock);
+	}
+	result = !job.failed;
+
+	INTERNAL_mutexUnlock(&converter->lock);
+
+	return result;
+}
+
+int df_readvideo_rgba(
+	AV1_Context *context,
+	int numFrames,
+	uint8_t *rgba,
+	uint32_t stride,
+	RGBAFormat format
+) {
+	Context *internalContext = (Context*) context;
+	Dav1dPicture view;
+
+	if (!INTERNAL_readPicture(internalContext, numFrames, &internalContext->currentPicture))
+	{
+		return 0;
+	}
+
+	INTERNAL_outputView(internalContext, &view);
+	return INTERNAL_convertPicture(internalContext, &view, rgba, stride, format);
+}
+
+/* Semi-planar output */
+
+int df_readvideo_semiplanar(
+	AV1_Context *context,
+	int numFrames,
+	void *yData,
+	uint32_t yStride,
+	void *uvData,
+	uint32_t uvStride
+) {
+	Context *internalContext = (Context*) context;
+	Dav1dPicture view;
+
+	if (!INTERNAL_readPicture(internalContext, numFrames, &internalContext->currentPicture))
+	{
+		return 0;
+	}
+
+	INTERNAL_outputView(internalContext, &view);
+	return df_INTERNAL_copySemiPlanar(
+		&view,
+		(uint8_t*) yData,
+		yStride,
+		(uint8_t*) uvData,
+		uvStride
+	);
+}
+
+/* 8-bit output */
+
+int df_readvideo_8bit(
+	AV1_Context *context,
+	int numFrames,
+	void *yData,
+	void *uData,
+	void *vData,
+	uint32_t yStride,
+	uint32_t uvStride,
+	uint8_t dither
+) {
+	Context *internalContext = (Context*) context;
+	Dav1dPicture view;
+
+	if (!INTERNAL_readPicture(internalContext, numFrames, &internalContext->currentPicture))
+	{
+		return 0;
+	}
+
+	INTERNAL_outputView(internalContext, &view);
+	return df_INTERNAL_copy8Bit(
+		&view,
+		(uint8_t*) yData,
+		(uint8_t*) uData,
+		(uint8_t*) vData,
+		yStride,
+		uvStride,
+		dither
+	);
+}
+
+/* Packed output */
+
+int df_readvideo_packed(
+	AV1_Context *context,
+	int numFrames,
+	void *yData,
+	void *uData,
+	void *vData,
+	uint32_t alignment,
+	uint32_t *yDataLength,
+	uint32_t *uvDataLength,
+	uint32_t *yStride,
+	uint32_t *uvStride
+) {
+	Context *internalContext = (Context*) context;
+	Dav1dPicture view;
+
+	if (!INTERNAL_readPicture(internalContext, numFrames, &internalContext->currentPicture))
+	{
+		return 0;
+	}
+
+	INTERNAL_outputView(internalContext, &view);
+	return df_INTERNAL_copyPacked(
+		&view,
+		(uint8_t*) yData,
+		(uint8_t*) uData,
+		(uint8_t*) vData,
+		alignment,
+		yDataLength,
+		uvDataLength,
+		yStride,
+		uvStride
+	);
+}
+
+/* Scaled output */
+
+int df_readvideo_scaled(
+	AV1_Context *context,
+	int numFrames,
+	void *yData,
+	void *uData,
+	void *vData,
+	int width,
+	int height,
+	uint32_t yStride,
+	uint32_t uvStride
+) {
+	Context *internalContext = (Context*) context;
+	Dav1dPicture view;
+
+	if (!INTERNAL_readPicture(internalContext, numFrames, &internalContext->currentPicture))
+	{
+		return 0;
+	}
+
+	INTERNAL_outputView(internalContext, &view);
+	if (!INTERNAL_growScratch(internalContext, view.p.w))
+	{
+		return 0;
+	}
+
+	return df_INTERNAL_copyScaled(
+		&view,
+		(uint8_t*) yData,
+		(uint8_t*) uData,
+		(uint8_t*) vData,
+		width,
+		height,
+		yStride,
+		uvStride,
+		(uint32_t*) internalContext->convertScratch
+	);
+}
+
+int df_eos(AV1_Context *context)
+{
+	return ((Context *) context)->eof;
+}
+
+void df_set_loop(AV1_Context *context, uint8_t enabled)
+{
+	INTERNAL_atomicStore(&((Context*) context)->loop, enabled != 0);
+}
+
+/* Playlists */
+
+/* Appends source, its sequence header read now so the switch costs nothing.
+ * The first one queued takes over the context's own bitstream.
+ */
+static int INTERNAL_queueSource(Context *context, Source *source)
+{
+	Source *first, *tail;
+	Pool *pool;
+
+	/* A stream can't be told apart from what follows it */
+	if (context->readFunc != NULL || !INTERNAL_findSequenceHeader(source))
+	{
+		return 0;
+	}
+
+	if (context->playing == NULL)
+	{
+		first = calloc(1, sizeof(Source));
+		if (!first)
+		{
+			return 0;
+		}
+		first->bitstreamData = context->bitstreamData;
+		first->bitstreamDataSize = context->bitstreamDataSize;
+		if (!INTERNAL_findSequenceHeader(first))
+		{
+			free(first);
+			return 0;
+		}
+		first->ownsBitstream = context->ownsBitstream;
+		first->mapped = context->mapped;
+		first->started = 1;
+
+		/* The index thread looks for the source playing */
+		INTERNAL_waitForIndex(context);
+
+		INTERNAL_mutexLock(&context->sourceLock);
+		context->playing = first;
+		context->feeding = first;
+		context->ownsBitstream = 0;
+		INTERNAL_mutexUnlock(&context->sourceLock);
+	}
+
+	INTERNAL_mutexLock(&context->sourceLock);
+	tail = context->playing;
+	while (tail->next != NULL)
+	{
+		tail = tail->next;
+	}
+	source->compatible = INTERNAL_compatibleSources(&tail->sequenceHeader, &source->sequenceHeader);
+	tail->next = source;
+	INTERNAL_mutexUnlock(&context->sourceLock);
+
+	/* Decoding may have stopped at the end already */
+	context->eof = 0;
+	pool = context->pool;
+	if (pool != NULL)
+	{
+		INTERNAL_mutexLock(&pool->lock);
+		if (context->decodeResult == 0)
+		{
+			context->decodeResult = 1;
+			INTERNAL_conditionSignal(&pool->workReady);
+		}
+		INTERNAL_mutexUnlock(&pool->lock);
+	}
+
+	return 1;
+}
+
+int df_queue_memory(AV1_Context *context, uint8_t *bytes, uint64_t size)
+{
+	Source *source;
+
+	if (size == 0 || size > SIZE_MAX)
+	{
+		return 0;
+	}
+
+	source = calloc(1, sizeof(Source));
+	if (!source)
+	{
+		return 0;
+	}
+	source->bitstreamData = bytes;
+	source->bitstreamDataSize = (size_t) size;
+
+	if (!INTERNAL_queueSource((Context*) context, source))
+	{
+		free(source);
+		return 0;
+	}
+
+	return 1;
+}
+
+int df_queue_file(AV1_Context *context, const char *fname)
+{
+	Source *source;
+#if !defined(_WIN32) && !defined(DF_HAVE_MMAP)
+	FILE *file;
+
+	/* No mapping support on this platform, just read the file */
+	file = fopen(fname, "rb");
+	if (!file)
 	{
-		context->currentOBUSize += offset; /* adding header size back in */
+		return 0;
 	}
 
-	return result >= 0;
-}
+	source = calloc(1, sizeof(Source));
+	if (!source)
+	{
+		fclose(file);
+		return 0;
+	}
 
-// 1 = success
-// 0 = end of stream
-// -1 = error
-static int df_INTERNAL_read_data(Context *internalContext, Dav1dData *data)
-{
-	if (internalContext->bitstreamIndex >= internalContext->bitstreamDataSize)
+	source->bitstreamData = INTERNAL_readFile(file, &source->bitstreamDataSize);
+#else
+	source = calloc(1, sizeof(Source));
+	if (!source)
 	{
 		return 0;
 	}
 
-	if (!INTERNAL_getNextPacket(internalContext))
+	/* Pages come in as the feed gets there, see INTERNAL_useSource */
+	source->bitstreamData = INTERNAL_mapFile(fname, &source->bitstreamDataSize);
+	source->mapped = 1;
+#endif
+	if (!source->bitstreamData)
 	{
-		return -1;
+		free(source);
+		return 0;
 	}
+	source->ownsBitstream = 1;
 
-	if (dav1d_data_wrap(data, internalContext->bitstreamData + internalContext->bitstreamIndex, internalContext->currentOBUSize, allocator_no_op, NULL) < 0)
+	if (!INTERNAL_queueSource((Context*) context, source))
 	{
-		return -1;
+		INTERNAL_freeSource(source);
+		return 0;
 	}
 
 	return 1;
 }
 
-int df_open_from_memory(uint8_t *bytes, uint32_t size, AV1_Context **context)
+uint32_t df_queue_length(AV1_Context *context)
 {
-	Context *internalContext = malloc(sizeof(Context));
-	if (!internalContext)
+	Context *internalContext = (Context*) context;
+	Source *source;
+	uint32_t count;
+
+	if (internalContext->playing == NULL)
 	{
 		return 0;
 	}
-	Dav1dContext *dav1dContext = malloc(sizeof(void*));
-	if (!dav1dContext)
+
+	count = 0;
+	INTERNAL_mutexLock(&internalContext->sourceLock);
+	for (source = internalContext->playing->next; source != NULL; source = source->next)
 	{
-		free(internalContext);
-		return 0;
+		count += 1;
 	}
-	Dav1dSettings settings;
-	Dav1dSequenceHeader sequenceHeader;
-	int result;
+	INTERNAL_mutexUnlock(&internalContext->sourceLock);
 
-	internalContext->bitstreamData = bytes;
-	internalContext->bitstreamDataSize = size;
-	internalContext->bitstreamIndex = 0;
-	internalContext->currentOBUSize = 0;
-	internalContext->eof = 0;
-	internalContext->width = 0;
-	internalContext->height = 0;
-	internalContext->hbd = 0;
-	internalContext->timing_info_present = 0;
-	internalContext->num_units_in_tick = 0;
-	internalContext->time_scale = 0;
-	internalContext->equal_picture_interval = 0;
-	internalContext->num_ticks_per_picture = 0;
-	memset(&internalContext->currentPicture, '\0', sizeof(Dav1dPicture));
+	return count;
+}
 
-	dav1d_default_settings(&settings);
-	settings.apply_grain = 0;
+/* Throws away everything decoded or queued, the caller has paused decoding */
+static void INTERNAL_flush(Context *context)
+{
+	dav1d_flush(context->dav1dContext);
+	dav1d_data_unref(&context->pendingData);
+	INTERNAL_dropFrames(context);
+	INTERNAL_atomicStore(&context->skipToFrame, 0);
+	context->decodeResult = 1;
+}
 
-	result = dav1d_open(&dav1dContext, &settings);
-	if (result < 0)
-	{
-		free(dav1dContext);
-		free(internalContext);
-		return 0;
-	}
+void df_reset(AV1_Context *context)
+{
+	Context *internalContext = (Context*) context;
 
-	internalContext->dav1dContext = dav1dContext;
+	INTERNAL_pauseDecoding(internalContext);
+	INTERNAL_flush(internalContext);
+	INTERNAL_rewind(internalContext);
+
+	/* Whatever plays next may be a different size */
+	INTERNAL_mutexLock(&internalContext->allocator->lock);
+	INTERNAL_trimPictures(internalContext->allocator, 0);
+	INTERNAL_mutexUnlock(&internalContext->allocator->lock);
+
+	INTERNAL_resumeDecoding(internalContext);
+}
+
+int df_set_picture_allocator(
+	AV1_Context *context,
+	df_alloc_picture_func alloc,
+	df_release_picture_func release,
+	void *userdata
+) {
+	Context *internalContext = (Context*) context;
+	Allocator *allocator;
+	Dav1dContext *dav1dContext;
 
-	while (INTERNAL_getNextPacket(internalContext))
+	if (alloc == NULL || release == NULL)
 	{
-		if (dav1d_parse_sequence_header(
-				&sequenceHeader,
-				internalContext->bitstreamData + internalContext->bitstreamIndex,
-				internalContext->currentOBUSize
-			) == 0)
-		{
-			internalContext->width = sequenceHeader.max_width;
-			internalContext->height = sequenceHeader.max_height;
-			internalContext->pixelLayout = (PixelLayout) sequenceHeader.layout;
-			internalContext->hbd = sequenceHeader.hbd;
+		alloc = NULL;
+		release = NULL;
+	}
 
-			internalContext->timing_info_present = sequenceHeader.timing_info_present;
-			internalContext->num_units_in_tick = sequenceHeader.num_units_in_tick;
-			internalContext->time_scale = sequenceHeader.time_scale;
-			internalContext->equal_picture_interval = sequenceHeader.equal_picture_interval;
-			internalContext->num_ticks_per_picture = sequenceHeader.num_ticks_per_picture;
-			break;
-		}
+	allocator = INTERNAL_createAllocator(alloc, release, userdata);
+	if (!allocator)
+	{
+		return 0;
 	}
 
-	/* Did not find a valid sequence header! */
-	if (internalContext->width == 0 || internalContext->height == 0 || internalContext->pixelLayout == PIXEL_LAYOUT_I400)
+	dav1dContext = NULL;
+	if (!INTERNAL_openDecoder(&internalContext->settings, allocator, &dav1dContext))
 	{
-		dav1d_close(&dav1dContext);
-		free(dav1dContext);
-		free(internalContext);
+		INTERNAL_releaseAllocator(allocator);
 		return 0;
 	}
 
-	/* Reset the stream index */
-	internalContext->bitstreamIndex = 0;
-	internalContext->currentOBUSize = 0;
+	INTERNAL_pauseDecoding(internalContext);
+	INTERNAL_flush(internalContext);
+	dav1d_picture_unref(&internalContext->currentPicture);
+	dav1d_close(&internalContext->dav1dContext);
+	INTERNAL_releaseAllocator(internalContext->allocator);
 
-	*context = (AV1_Context*) internalContext;
+	internalContext->dav1dContext = dav1dContext;
+	internalContext->allocator = allocator;
+	INTERNAL_rewind(internalContext);
+	INTERNAL_resumeDecoding(internalContext);
 
 	return 1;
 }
 
-static int df_open_from_file(FILE *file, AV1_Context **context)
+void df_picture_pool_stats(AV1_Context *context, uint64_t *hits, uint64_t *misses)
 {
-	unsigned int len, start, result;
+	Allocator *allocator = ((Context*) context)->allocator;
 
-	start = (unsigned int) ftell(file);
-	fseek(file, 0, SEEK_END);
-	len = (unsigned int) (ftell(file) - start);
-	fseek(file, start, SEEK_SET);
+	INTERNAL_mutexLock(&allocator->lock);
+	*hits = allocator->hits;
+	*misses = allocator->misses;
+	INTERNAL_mutexUnlock(&allocator->lock);
+}
 
-	unsigned char *bytes = malloc(len);
-	if (!bytes)
+/* Points the feed at the key frame before frame, so that decoding picks up
+ * there. The caller has paused decoding, flushed and built the index.
+ */
+static int INTERNAL_seekTo(Context *context, uint32_t frame)
+{
+	uint32_t keyFrame, passStart;
+	size_t position, pageSize;
+
+	INTERNAL_rollbackFeed(context);
+
+	/* A looped frame is found in its own pass */
+	passStart = frame - (frame - context->frameBase) % context->indexCount;
+	keyFrame = frame;
+	while (keyFrame > passStart && !INTERNAL_indexEntry(context, keyFrame)->keyFrame)
+	{
+		keyFrame -= 1;
+	}
+	position = (size_t) INTERNAL_indexEntry(context, keyFrame)->offset;
+
+	/* The flush dropped the sequence header, so it goes in ahead of the key frame */
+	if (dav1d_data_wrap(
+		&context->pendingData,
+		context->bitstreamData + context->sequenceHeaderOffset,
+		context->sequenceHeaderSize,
+		allocator_no_op,
+		NULL) < 0)
 	{
-		fclose(file);
 		return 0;
 	}
+	context->pendingData.m.timestamp = (int64_t) keyFrame;
+	context->pendingData.m.offset = (int64_t) INTERNAL_indexTime(context, keyFrame);
 
-	result = (unsigned int) fread(bytes, 1, len, file);
-	fclose(file);
+	/* The header parser needs it too */
+	INTERNAL_inspectOBU(
+		context->feedParser,
+		context->bitstreamData + context->sequenceHeaderOffset,
+		context->sequenceHeaderSize,
+		context->feedInfo
+	);
 
-	if (result != len)
+	context->bitstreamIndex = position;
+	context->currentOBUSize = 0;
+	context->feedFrame = keyFrame;
+	context->feedShown = 0;
+	context->feedDropping = 0;
+	INTERNAL_resetClock(
+		&context->feedClock,
+		INTERNAL_indexTime(context, keyFrame),
+		(keyFrame > context->frameBase) ? INTERNAL_indexTime(context, keyFrame) - INTERNAL_indexTime(context, keyFrame - 1) : 1
+	);
+	context->nextFrame = frame;
+	INTERNAL_atomicStore(&context->skipToFrame, frame);
+	context->eof = 0;
+
+	if (context->mapped)
 	{
-		return 0;
+		pageSize = INTERNAL_pageSize();
+		if (position < context->releasedIndex)
+		{
+			context->releasedIndex = position & ~(pageSize - 1);
+		}
+		INTERNAL_adviseWillNeed(context->bitstreamData + position, context->bitstreamDataSize - position);
 	}
 
-	return df_open_from_memory(bytes, len, context);
+	return 1;
 }
 
-int df_fopen(const char *fname, AV1_Context **context)
+/* Restarts decoding at frame, the index being ready */
+static int INTERNAL_seek(Context *context, uint32_t frame)
 {
-	FILE *f = fopen(fname, "rb");
+	INTERNAL_pauseDecoding(context);
+	INTERNAL_flush(context);
 
-	if (f)
+	if (!INTERNAL_seekTo(context, frame))
 	{
-		return df_open_from_file(f, context);
+		INTERNAL_rewind(context);
+		INTERNAL_resumeDecoding(context);
+		return 0;
 	}
 
-	return 0;
+	INTERNAL_resumeDecoding(context);
+
+	return 1;
 }
 
-void df_videoinfo(
-	AV1_Context *context,
-	int *width,
-	int *height,
-	PixelLayout *pixelLayout
-) {
+int df_seek(AV1_Context *context, uint32_t frame)
+{
 	Context *internalContext = (Context*) context;
 
-	*width = internalContext->width;
-	*height = internalContext->height;
-	*pixelLayout = internalContext->pixelLayout;
+	if (!df_build_index(context, 0) || frame >= internalContext->indexCount)
+	{
+		return 0;
+	}
+
+	return INTERNAL_seek(internalContext, internalContext->frameBase + frame);
 }
 
-void df_videoinfo2(
-	AV1_Context *context,
-	int *width,
-	int *height,
-	PixelLayout *pixelLayout,
-	uint8_t *hbd
-) {
-	Context *internalContext = (Context*) context;
+/* The frame on screen at ticks. Without the index, a fixed interval still says
+ * exactly, otherwise the interval of the current frame has to do. So does it
+ * past the end of a source another one follows.
+ */
+static uint32_t INTERNAL_frameAtTime(Context *context, uint64_t ticks)
+{
+	const Dav1dPicture *picture = &context->currentPicture;
+	uint32_t low, high, middle, passStart;
+	uint64_t time, interval, loopTicks, relative;
 
-	*width = internalContext->width;
-	*height = internalContext->height;
-	*pixelLayout = internalContext->pixelLayout;
-	*hbd = internalContext->hbd;
-}
+	relative = (ticks > context->timeBase) ? ticks - context->timeBase : 0;
 
-int df_guessframerate(
-	AV1_Context *context,
-	double *fps
-) {
-	Context *internalContext = (Context*) context;
+	if (context->indexState == INDEX_STATE_READY && context->indexCount > 0)
+	{
+		passStart = context->frameBase;
+		loopTicks = INTERNAL_loopTicks(context);
+		if (INTERNAL_indexLoops(context))
+		{
+			passStart += (uint32_t) (relative / loopTicks) * context->indexCount;
+			relative %= loopTicks;
+		}
 
-	// Note that most encoders do not set this information by default
-	if (internalContext->timing_info_present && internalContext->equal_picture_interval) {
-		*fps = (double)internalContext->time_scale / (internalContext->num_ticks_per_picture * internalContext->num_units_in_tick);
-		return 1;
+		if (relative < loopTicks || !INTERNAL_hasNextSource(context))
+		{
+			/* Last entry at or before relative */
+			low = 0;
+			high = context->indexCount;
+			while (high - low > 1)
+			{
+				middle = low + (high - low) / 2;
+				if (context->index[middle].presentationTime <= relative)
+				{
+					low = middle;
+				}
+				else
+				{
+					high = middle;
+				}
+			}
+			return passStart + low;
+		}
 	}
-	else
+	else if (context->equal_picture_interval && context->num_ticks_per_picture > 0)
 	{
-		return 0;
+		return context->frameBase + (uint32_t) (relative / context->num_ticks_per_picture);
+	}
+
+	if (picture->data[0] == NULL)
+	{
+		return context->nextFrame;
+	}
+
+	time = (uint64_t) picture->m.offset;
+	interval = (picture->m.duration > 0) ? (uint64_t) picture->m.duration : 1;
+	if (ticks < time)
+	{
+		return (uint32_t) picture->m.timestamp;
 	}
+	return (uint32_t) (picture->m.timestamp + (ticks - time) / interval);
 }
 
-int df_readvideo(
+int df_read_for_time(
 	AV1_Context *context,
-	int numFrames,
+	double time,
+	uint32_t *framesDropped,
 	void **yData,
 	void **uData,
 	void **vData,
@@ -311,88 +4762,185 @@ int df_readvideo(
 	uint32_t *uvStride
 ) {
 	Context *internalContext = (Context*) context;
-	Dav1dData data = {0};
-	int res;
-	int got_picture = 0;
-	//int i;
+	uint32_t frame, keyFrame, previous;
+	uint64_t ticks;
+	int numFrames;
 
-	for (int i = 0; i < numFrames; i += 1)
+	*framesDropped = 0;
+
+	if (	!internalContext->timing_info_present ||
+		internalContext->time_scale == 0 ||
+		internalContext->num_units_in_tick == 0	)
+	{
+		return -1;
+	}
+
+	/* The index turns a time into a frame without decoding anything */
+	if (internalContext->readFunc == NULL && !df_build_index(context, 0))
 	{
-		dav1d_picture_unref(&internalContext->currentPicture);
+		return -1;
+	}
+
+	ticks = (time > 0.0) ? (uint64_t) (time * internalContext->time_scale / internalContext->num_units_in_tick) : 0;
+	frame = INTERNAL_frameAtTime(internalContext, ticks);
+	previous = internalContext->nextFrame;
 
-		if (df_INTERNAL_read_data(internalContext, &data) == 1)
+	if (frame < previous)
+	{
+		/* Still showing the current frame, or the first one is not due yet */
+		if (internalContext->currentPicture.data[0] != NULL)
 		{
-			do
-			{
-				res = dav1d_send_data(internalContext->dav1dContext, &data);
-				// Keep going even if the function can't consume the current data
-				//   packet. It eventually will after one or more frames have been
-				//   returned in this loop.
-				if (res < 0 && res != DAV1D_ERR(EAGAIN)) {
-					return 0;
-				}
-				res = dav1d_get_picture(internalContext->dav1dContext, &internalContext->currentPicture);
-				if (res < 0)
-				{
-					if (res != DAV1D_ERR(EAGAIN)) {
-						return 0;
-					}
-				}
-				else
-				{
-					got_picture = 1;
-					break;
-				}
-				// Stay in the loop as long as there's data to consume.
-			} while (data.sz || df_INTERNAL_read_data(internalContext, &data) == 1);
+			return 0;
 		}
+		frame = previous;
+	}
 
-		if (!got_picture)
+	/* Past a key frame, decoding can start over there. The index ends with the source. */
+	if (	internalContext->indexState == INDEX_STATE_READY &&
+		internalContext->indexCount > 0 &&
+		(frame - internalContext->frameBase < internalContext->indexCount || INTERNAL_indexLoops(internalContext))	)
+	{
+		keyFrame = frame;
+		while (keyFrame > previous && !INTERNAL_indexEntry(internalContext, keyFrame)->keyFrame)
 		{
-			// end of bitstream, keep decoding
-			res = dav1d_get_picture(internalContext->dav1dContext, &internalContext->currentPicture);
-			if (res < 0)
-			{
-				internalContext->eof = 1;
-				return 0;
-			}
+			keyFrame -= 1;
+		}
+
+		if (keyFrame > previous && !INTERNAL_seek(internalContext, frame))
+		{
+			return -1;
 		}
 	}
 
-	/* Set the picture data pointers */
-	*yData = internalContext->currentPicture.data[0];
-	*uData = internalContext->currentPicture.data[1];
-	*vData = internalContext->currentPicture.data[2];
-	*yStride = internalContext->currentPicture.stride[0];
-	*uvStride = internalContext->currentPicture.stride[1];
+	numFrames = (frame - internalContext->nextFrame < INT32_MAX) ? (int) (frame - internalContext->nextFrame) + 1 : INT32_MAX;
+	if (!INTERNAL_readPicture(internalContext, numFrames, &internalContext->currentPicture))
+	{
+		/* Running out of frames is not an error */
+		return internalContext->eof ? 0 : -1;
+	}
 
-	const int ss_ver = internalContext->currentPicture.p.layout == DAV1D_PIXEL_LAYOUT_I420;
-	const int aligned_h = (internalContext->currentPicture.p.h + 127) & ~127;
-    *yDataLength = *yStride * aligned_h;
-    *uvDataLength = *uvStride * (aligned_h >> ss_ver);
+	*framesDropped = (uint32_t) internalContext->currentPicture.m.timestamp - previous;
 
-	return 1;
-}
+	INTERNAL_getPlanes(
+		&internalContext->currentPicture,
+		yData,
+		uData,
+		vData,
+		yDataLength,
+		uvDataLength,
+		yStride,
+		uvStride
+	);
 
-int df_eos(AV1_Context *context)
-{
-	return ((Context *) context)->eof;
+	return 1;
 }
 
-void df_reset(AV1_Context *context)
+int df_set_decode_quality(AV1_Context *context, uint32_t inloopFilters, uint8_t applyGrain)
 {
 	Context *internalContext = (Context*) context;
-	dav1d_flush(internalContext->dav1dContext);
-	internalContext->bitstreamIndex = 0;
-	internalContext->currentOBUSize = 0;
-	internalContext->eof = 0;
+	DecoderSettings settings;
+	Dav1dContext *dav1dContext;
+	uint32_t frame;
+
+	INTERNAL_atomicStore(&internalContext->applyGrain, applyGrain != 0);
+
+	inloopFilters &= INLOOP_FILTER_ALL;
+	if (inloopFilters == (internalContext->settings.inloopFilters & INLOOP_FILTER_ALL))
+	{
+		return 1;
+	}
+
+	/* dav1d only takes the filters at open, so decoding restarts on a new
+	 * decoder from the key frame before the next frame to be read
+	 */
+	if (!df_build_index(context, 0))
+	{
+		return 0;
+	}
+
+	settings = internalContext->settings;
+	settings.inloopFilters = inloopFilters;
+
+	dav1dContext = NULL;
+	if (!INTERNAL_openDecoder(&settings, internalContext->allocator, &dav1dContext))
+	{
+		return 0;
+	}
+
+	INTERNAL_pauseDecoding(internalContext);
+	INTERNAL_flush(internalContext);
+	dav1d_close(&internalContext->dav1dContext);
+
+	internalContext->dav1dContext = dav1dContext;
+	internalContext->settings = settings;
+
+	frame = internalContext->nextFrame;
+	if (	internalContext->indexCount == 0 ||
+		(frame - internalContext->frameBase >= internalContext->indexCount && !INTERNAL_indexLoops(internalContext))	)
+	{
+		/* Nothing left to decode, but a queued source may follow on from the last frame */
+		INTERNAL_rollbackFeed(internalContext);
+		internalContext->bitstreamIndex = internalContext->bitstreamDataSize;
+		internalContext->currentOBUSize = 0;
+		internalContext->feedFrame = frame;
+		internalContext->feedShown = 0;
+		internalContext->feedDropping = 0;
+		if (internalContext->indexCount > 1)
+		{
+			INTERNAL_resetClock(
+				&internalContext->feedClock,
+				INTERNAL_indexTime(internalContext, frame - 1),
+				INTERNAL_indexTime(internalContext, frame - 1) - INTERNAL_indexTime(internalContext, frame - 2)
+			);
+		}
+	}
+	else if (!INTERNAL_seekTo(internalContext, frame))
+	{
+		/* The new filters are in, but playback went back to the start */
+		INTERNAL_rewind(internalContext);
+		INTERNAL_resumeDecoding(internalContext);
+		return 0;
+	}
+
+	INTERNAL_resumeDecoding(internalContext);
+
+	return 1;
 }
 
 void df_close(AV1_Context *context)
 {
 	Context *internalContext = (Context*) context;
+	Source *source;
 
+	INTERNAL_detach(internalContext);
+	INTERNAL_dropFrames(internalContext);
+	free(internalContext->frameQueue);
+
+	if (internalContext->converter != NULL)
+	{
+		INTERNAL_releaseConverter(internalContext->converter);
+	}
+	free(internalContext->convertScratch);
+
+	INTERNAL_waitForIndex(internalContext);
+	free(internalContext->index);
+	free(internalContext->feedParser);
+	free(internalContext->feedInfo);
+
+	dav1d_data_unref(&internalContext->pendingData);
+	dav1d_picture_unref(&internalContext->currentPicture);
 	dav1d_close(&internalContext->dav1dContext);
+	INTERNAL_releaseAllocator(internalContext->allocator);
+
+	/* dav1d is closed, nothing can reference the bitstream anymore */
+	INTERNAL_freeBitstream(internalContext);
+	while (internalContext->playing != NULL)
+	{
+		source = internalContext->playing;
+		internalContext->playing = source->next;
+		INTERNAL_freeSource(source);
+	}
+	INTERNAL_mutexDestroy(&internalContext->sourceLock);
 
 	free(internalContext);
 }
@@ -0,0 +1,1391 @@
+/* dav1dfile - AV1 Video Decoder Library
+ *
+ * Copyright (c) 2023 Evan Hemsley
+ *
+ * This software is provided 'as-is', without any express or implied warranty.
+ * In no event will the authors be held liable for any damages arising from
+ * the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ * claim that you wrote the original software. If you use this software in a
+ * product, an acknowledgment in the product documentation would be
+ * appreciated but is not required.
+ *
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ * misrepresented as being the original software.
+ *
+ * 3. This notice may not be removed or altered from any source distribution.
+ *
+ * Evan "cosmonaut" Hemsley <evan@moonside.games>
+ *
+ */
+
+#include "dav1dfile_convert.h"
+
+#include <string.h>
+
+#if defined(__x86_64__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+#define DF_HAVE_SSE2
+#include <emmintrin.h>
+#endif
+
+#if (defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)) && (defined(__GNUC__) || defined(_MSC_VER))
+#define DF_HAVE_AVX2
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#if defined(__GNUC__) || defined(__clang__)
+#define DF_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define DF_TARGET_AVX2
+#endif
+#endif
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__) || defined(_M_ARM64)
+#define DF_HAVE_NEON
+#include <arm_neon.h>
+#endif
+
+/* Output keeps this many fractional bits until the final rounding */
+#define RGBA_FRACTION_BITS 4
+
+/* Upsampled chroma keeps this many, 12-bit samples still fit in 16 bits */
+#define CHROMA_FRACTION_BITS 3
+
+/* Setup */
+
+void df_INTERNAL_setupRGBA(const Dav1dPicture *picture, RGBAFormat format, RGBAConversion *conversion)
+{
+	const Dav1dSequenceHeader *sequenceHeader = picture->seq_hdr;
+	const int depth = picture->p.bpc;
+	double kr, kb, kg, yScale, cScale, yOffset, cOffset;
+	double matrix[3][3];
+	int row, column;
+
+	/* BT.709 when unspecified, it is what HD content uses */
+	kr = 0.2126;
+	kb = 0.0722;
+	switch (sequenceHeader->mtrx)
+	{
+		case DAV1D_MC_FCC:
+			kr = 0.30;
+			kb = 0.11;
+			break;
+		case DAV1D_MC_BT470BG:
+		case DAV1D_MC_BT601:
+			kr = 0.299;
+			kb = 0.114;
+			break;
+		case DAV1D_MC_SMPTE240:
+			kr = 0.212;
+			kb = 0.087;
+			break;
+		case DAV1D_MC_BT2020_NCL:
+		case DAV1D_MC_BT2020_CL: /* the constant luminance variant is not linear, this is close */
+			kr = 0.2627;
+			kb = 0.0593;
+			break;
+		default:
+			break;
+	}
+	kg = 1.0 - kr - kb;
+
+	if (sequenceHeader->color_range)
+	{
+		yScale = 255.0 / ((1 << depth) - 1);
+		cScale = yScale;
+		yOffset = 0;
+		cOffset = 1 << (depth - 1);
+	}
+	else
+	{
+		yScale = 255.0 / (219 << (depth - 8));
+		cScale = 255.0 / (224 << (depth - 8));
+		yOffset = 16 << (depth - 8);
+		cOffset = 128 << (depth - 8);
+	}
+
+	memset(matrix, '\0', sizeof(matrix));
+	if (sequenceHeader->mtrx == DAV1D_MC_IDENTITY)
+	{
+		/* GBR, every plane is coded like luma */
+		matrix[0][2] = yScale;
+		matrix[1][0] = yScale;
+		matrix[2][1] = yScale;
+		cOffset = yOffset;
+	}
+	else if (sequenceHeader->mtrx == DAV1D_MC_SMPTE_YCGCO)
+	{
+		matrix[0][0] = yScale;
+		matrix[0][1] = -cScale;
+		matrix[0][2] = cScale;
+		matrix[1][0] = yScale;
+		matrix[1][1] = cScale;
+		matrix[2][0] = yScale;
+		matrix[2][1] = -cScale;
+		matrix[2][2] = -cScale;
+	}
+	else
+	{
+		matrix[0][0] = yScale;
+		matrix[0][2] = 2.0 * (1.0 - kr) * cScale;
+		matrix[1][0] = yScale;
+		matrix[1][1] = -2.0 * kb * (1.0 - kb) / kg * cScale;
+		matrix[1][2] = -2.0 * kr * (1.0 - kr) / kg * cScale;
+		matrix[2][0] = yScale;
+		matrix[2][1] = 2.0 * (1.0 - kb) * cScale;
+	}
+
+	conversion->shift = (int16_t) (15 - depth);
+	conversion->chromaShift = (int16_t) (conversion->shift - CHROMA_FRACTION_BITS);
+	conversion->offsets[0] = (int16_t) yOffset;
+	conversion->offsets[1] = (int16_t) ((int32_t) cOffset << CHROMA_FRACTION_BITS);
+	conversion->offsets[2] = conversion->offsets[1];
+
+	/* Scaled for (a * coefficient) >> 16, and even so NEON's doubling multiply
+	 * computes the same thing with half the coefficient
+	 */
+	for (row = 0; row < 3; row += 1)
+	{
+		for (column = 0; column < 3; column += 1)
+		{
+			double scaled = matrix[row][column] * (1 << (16 + RGBA_FRACTION_BITS - conversion->shift - 1));
+			conversion->coefficients[row][column] = (int16_t) (2 * (int32_t) (scaled + (scaled < 0 ? -0.5 : 0.5)));
+		}
+	}
+
+	conversion->bgra = format == RGBA_FORMAT_BGRA;
+	conversion->hbd = depth > 8;
+	conversion->chromaColocated = sequenceHeader->chr == DAV1D_CHR_COLOCATED;
+}
+
+/* Row kernels */
+
+static inline uint8_t INTERNAL_rgbaChannel(const int16_t *coefficients, int32_t y, int32_t u, int32_t v)
+{
+	int32_t value =
+		((y * coefficients[0]) >> 16) +
+		((u * coefficients[1]) >> 16) +
+		((v * coefficients[2]) >> 16);
+
+	value = (value + (1 << (RGBA_FRACTION_BITS - 1))) >> RGBA_FRACTION_BITS;
+	return (uint8_t) (value < 0 ? 0 : (value > 255 ? 255 : value));
+}
+
+static void INTERNAL_rgbaRowScalar(
+	const RGBAConversion *conversion,
+	const void *y,
+	const uint16_t *u,
+	const uint16_t *v,
+	uint8_t *rgba,
+	int32_t width
+) {
+	const int redIndex = conversion->bgra ? 2 : 0;
+	int32_t x, ay, au, av;
+
+	for (x = 0; x < width; x += 1)
+	{
+		ay = conversion->hbd ? ((const uint16_t*) y)[x] : ((const uint8_t*) y)[x];
+		ay = (ay - conversion->offsets[0]) * (1 << conversion->shift);
+		au = (u[x] - conversion->offsets[1]) * (1 << conversion->chromaShift);
+		av = (v[x] - conversion->offsets[2]) * (1 << conversion->chromaShift);
+
+		rgba[redIndex] = INTERNAL_rgbaChannel(conversion->coefficients[0], ay, au, av);
+		rgba[1] = INTERNAL_rgbaChannel(conversion->coefficients[1], ay, au, av);
+		rgba[2 - redIndex] = INTERNAL_rgbaChannel(conversion->coefficients[2], ay, au, av);
+		rgba[3] = 255;
+		rgba += 4;
+	}
+}
+
+#ifdef DF_HAVE_SSE2
+
+static inline __m128i INTERNAL_rgbaChannelSSE2(const int16_t *coefficients, __m128i y, __m128i u, __m128i v)
+{
+	__m128i value = _mm_add_epi16(
+		_mm_add_epi16(
+			_mm_mulhi_epi16(y, _mm_set1_epi16(coefficients[0])),
+			_mm_mulhi_epi16(u, _mm_set1_epi16(coefficients[1]))
+		),
+		_mm_mulhi_epi16(v, _mm_set1_epi16(coefficients[2]))
+	);
+
+	value = _mm_srai_epi16(_mm_add_epi16(value, _mm_set1_epi16(1 << (RGBA_FRACTION_BITS - 1))), RGBA_FRACTION_BITS);
+	return _mm_max_epi16(_mm_min_epi16(value, _mm_set1_epi16(255)), _mm_setzero_si128());
+}
+
+static void INTERNAL_rgbaRowSSE2(
+	const RGBAConversion *conversion,
+	const void *y,
+	const uint16_t *u,
+	const uint16_t *v,
+	uint8_t *rgba,
+	int32_t width
+) {
+	const __m128i shift = _mm_cvtsi32_si128(conversion->shift);
+	const __m128i chromaShift = _mm_cvtsi32_si128(conversion->chromaShift);
+	const __m128i yOffset = _mm_set1_epi16(conversion->offsets[0]);
+	const __m128i uOffset = _mm_set1_epi16(conversion->offsets[1]);
+	const __m128i vOffset = _mm_set1_epi16(conversion->offsets[2]);
+	const __m128i alpha = _mm_set1_epi16((short) 0xFF00);
+	__m128i ay, au, av, r, g, b, rg, ba;
+	int32_t x;
+
+	for (x = 0; x + 8 <= width; x += 8)
+	{
+		if (conversion->hbd)
+		{
+			ay = _mm_loadu_si128((const __m128i*) ((const uint16_t*) y + x));
+		}
+		else
+		{
+			ay = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*) ((const uint8_t*) y + x)), _mm_setzero_si128());
+		}
+		ay = _mm_sll_epi16(_mm_sub_epi16(ay, yOffset), shift);
+		au = _mm_sll_epi16(_mm_sub_epi16(_mm_loadu_si128((const __m128i*) (u + x)), uOffset), chromaShift);
+		av = _mm_sll_epi16(_mm_sub_epi16(_mm_loadu_si128((const __m128i*) (v + x)), vOffset), chromaShift);
+
+		r = INTERNAL_rgbaChannelSSE2(conversion->coefficients[0], ay, au, av);
+		g = INTERNAL_rgbaChannelSSE2(conversion->coefficients[1], ay, au, av);
+		b = INTERNAL_rgbaChannelSSE2(conversion->coefficients[2], ay, au, av);
+
+		if (conversion->bgra)
+		{
+			__m128i swap = r;
+			r = b;
+			b = swap;
+		}
+
+		/* Two bytes per pixel each, then interleaved into four */
+		rg = _mm_or_si128(r, _mm_slli_epi16(g, 8));
+		ba = _mm_or_si128(b, alpha);
+		_mm_storeu_si128((__m128i*) (rgba + x * 4), _mm_unpacklo_epi16(rg, ba));
+		_mm_storeu_si128((__m128i*) (rgba + x * 4 + 16), _mm_unpackhi_epi16(rg, ba));
+	}
+
+	if (x < width)
+	{
+		INTERNAL_rgbaRowScalar(
+			conversion,
+			conversion->hbd ? (const void*) ((const uint16_t*) y + x) : (const void*) ((const uint8_t*) y + x),
+			u + x,
+			v + x,
+			rgba + x * 4,
+			width - x
+		);
+	}
+}
+
+#endif /* DF_HAVE_SSE2 */
+
+#ifdef DF_HAVE_AVX2
+
+DF_TARGET_AVX2
+static inline __m256i INTERNAL_rgbaChannelAVX2(const int16_t *coefficients, __m256i y, __m256i u, __m256i v)
+{
+	__m256i value = _mm256_add_epi16(
+		_mm256_add_epi16(
+			_mm256_mulhi_epi16(y, _mm256_set1_epi16(coefficients[0])),
+			_mm256_mulhi_epi16(u, _mm256_set1_epi16(coefficients[1]))
+		),
+		_mm256_mulhi_epi16(v, _mm256_set1_epi16(coefficients[2]))
+	);
+
+	value = _mm256_srai_epi16(_mm256_add_epi16(value, _mm256_set1_epi16(1 << (RGBA_FRACTION_BITS - 1))), RGBA_FRACTION_BITS);
+	return _mm256_max_epi16(_mm256_min_epi16(value, _mm256_set1_epi16(255)), _mm256_setzero_si256());
+}
+
+DF_TARGET_AVX2
+static void INTERNAL_rgbaRowAVX2(
+	const RGBAConversion *conversion,
+	const void *y,
+	const uint16_t *u,
+	const uint16_t *v,
+	uint8_t *rgba,
+	int32_t width
+) {
+	const __m128i shift = _mm_cvtsi32_si128(conversion->shift);
+	const __m128i chromaShift = _mm_cvtsi32_si128(conversion->chromaShift);
+	const __m256i yOffset = _mm256_set1_epi16(conversion->offsets[0]);
+	const __m256i uOffset = _mm256_set1_epi16(conversion->offsets[1]);
+	const __m256i vOffset = _mm256_set1_epi16(conversion->offsets[2]);
+	const __m256i alpha = _mm256_set1_epi16((short) 0xFF00);
+	__m256i ay, au, av, r, g, b, rg, ba, low, high;
+	int32_t x;
+
+	for (x = 0; x + 16 <= width; x += 16)
+	{
+		if (conversion->hbd)
+		{
+			ay = _mm256_loadu_si256((const __m256i*) ((const uint16_t*) y + x));
+		}
+		else
+		{
+			ay = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*) ((const uint8_t*) y + x)));
+		}
+		ay = _mm256_sll_epi16(_mm256_sub_epi16(ay, yOffset), shift);
+		au = _mm256_sll_epi16(_mm256_sub_epi16(_mm256_loadu_si256((const __m256i*) (u + x)), uOffset), chromaShift);
+		av = _mm256_sll_epi16(_mm256_sub_epi16(_mm256_loadu_si256((const __m256i*) (v + x)), vOffset), chromaShift);
+
+		r = INTERNAL_rgbaChannelAVX2(conversion->coefficients[0], ay, au, av);
+		g = INTERNAL_rgbaChannelAVX2(conversion->coefficients[1], ay, au, av);
+		b = INTERNAL_rgbaChannelAVX2(conversion->coefficients[2], ay, au, av);
+
+		if (conversion->bgra)
+		{
+			__m256i swap = r;
+			r = b;
+			b = swap;
+		}
+
+		rg = _mm256_or_si256(r, _mm256_slli_epi16(g, 8));
+		ba = _mm256_or_si256(b, alpha);
+
+		/* Unpacking works within 128-bit lanes, so the halves come out crossed */
+		low = _mm256_unpacklo_epi16(rg, ba);
+		high = _mm256_unpackhi_epi16(rg, ba);
+		_mm256_storeu_si256((__m256i*) (rgba + x * 4), _mm256_permute2x128_si256(low, high, 0x20));
+		_mm256_storeu_si256((__m256i*) (rgba + x * 4 + 32), _mm256_permute2x128_si256(low, high, 0x31));
+	}
+
+	if (x < width)
+	{
+		INTERNAL_rgbaRowScalar(
+			conversion,
+			conversion->hbd ? (const void*) ((const uint16_t*) y + x) : (const void*) ((const uint8_t*) y + x),
+			u + x,
+			v + x,
+			rgba + x * 4,
+			width - x
+		);
+	}
+}
+
+static int INTERNAL_hasAVX2(void)
+{
+#ifdef _MSC_VER
+	int info[4];
+
+	__cpuid(info, 0);
+	if (info[0] < 7)
+	{
+		return 0;
+	}
+
+	/* The OS has to save the YMM registers too */
+	__cpuid(info, 1);
+	if (!(info[2] & (1 << 27)) || !(info[2] & (1 << 28)) || (_xgetbv(0) & 6) != 6)
+	{
+		return 0;
+	}
+
+	__cpuidex(info, 7, 0);
+	return (info[1] & (1 << 5)) != 0;
+#else
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx2");
+#endif
+}
+
+#endif /* DF_HAVE_AVX2 */
+
+#ifdef DF_HAVE_NEON
+
+static inline uint8x8_t INTERNAL_rgbaChannelNEON(const int16_t *coefficients, int16x8_t y, int16x8_t u, int16x8_t v)
+{
+	/* Doubling multiply with half the coefficient, same as (a * coefficient) >> 16 */
+	int16x8_t value = vaddq_s16(
+		vaddq_s16(
+			vqdmulhq_n_s16(y, (int16_t) (coefficients[0] / 2)),
+			vqdmulhq_n_s16(u, (int16_t) (coefficients[1] / 2))
+		),
+		vqdmulhq_n_s16(v, (int16_t) (coefficients[2] / 2))
+	);
+
+	return vqmovun_s16(vrshrq_n_s16(value, RGBA_FRACTION_BITS));
+}
+
+static void INTERNAL_rgbaRowNEON(
+	const RGBAConversion *conversion,
+	const void *y,
+	const uint16_t *u,
+	const uint16_t *v,
+	uint8_t *rgba,
+	int32_t width
+) {
+	const int16x8_t shift = vdupq_n_s16(conversion->shift);
+	const int16x8_t chromaShift = vdupq_n_s16(conversion->chromaShift);
+	const int16x8_t yOffset = vdupq_n_s16(conversion->offsets[0]);
+	const int16x8_t uOffset = vdupq_n_s16(conversion->offsets[1]);
+	const int16x8_t vOffset = vdupq_n_s16(conversion->offsets[2]);
+	int16x8_t ay, au, av;
+	uint8x8x4_t pixels;
+	int32_t x;
+
+	pixels.val[3] = vdup_n_u8(255);
+
+	for (x = 0; x + 8 <= width; x += 8)
+	{
+		if (conversion->hbd)
+		{
+			ay = vreinterpretq_s16_u16(vld1q_u16((const uint16_t*) y + x));
+		}
+		else
+		{
+			ay = vreinterpretq_s16_u16(vmovl_u8(vld1_u8((const uint8_t*) y + x)));
+		}
+		ay = vshlq_s16(vsubq_s16(ay, yOffset), shift);
+		au = vshlq_s16(vsubq_s16(vreinterpretq_s16_u16(vld1q_u16(u + x)), uOffset), chromaShift);
+		av = vshlq_s16(vsubq_s16(vreinterpretq_s16_u16(vld1q_u16(v + x)), vOffset), chromaShift);
+
+		pixels.val[conversion->bgra ? 2 : 0] = INTERNAL_rgbaChannelNEON(conversion->coefficients[0], ay, au, av);
+		pixels.val[1] = INTERNAL_rgbaChannelNEON(conversion->coefficients[1], ay, au, av);
+		pixels.val[conversion->bgra ? 0 : 2] = INTERNAL_rgbaChannelNEON(conversion->coefficients[2], ay, au, av);
+
+		vst4_u8(rgba + x * 4, pixels);
+	}
+
+	if (x < width)
+	{
+		INTERNAL_rgbaRowScalar(
+			conversion,
+			conversion->hbd ? (const void*) ((const uint16_t*) y + x) : (const void*) ((const uint8_t*) y + x),
+			u + x,
+			v + x,
+			rgba + x * 4,
+			width - x
+		);
+	}
+}
+
+#endif /* DF_HAVE_NEON */
+
+df_rgba_row_func df_INTERNAL_rgbaRowFunc(void)
+{
+#ifdef DF_HAVE_AVX2
+	if (INTERNAL_hasAVX2())
+	{
+		return INTERNAL_rgbaRowAVX2;
+	}
+#endif
+#if defined(DF_HAVE_SSE2)
+	return INTERNAL_rgbaRowSSE2;
+#elif defined(DF_HAVE_NEON)
+	return INTERNAL_rgbaRowNEON;
+#else
+	return INTERNAL_rgbaRowScalar;
+#endif
+}
+
+/* Chroma upsampling */
+
+/* dst[i] = weightA * rowA[i] + weightB * rowB[i], the weights add up to the scale */
+static void INTERNAL_blendChromaRows(
+	const Dav1dPicture *picture,
+	int plane,
+	int32_t rowA,
+	int32_t rowB,
+	int weightA,
+	int weightB,
+	int32_t width,
+	uint16_t *dst
+) {
+	const uint8_t *a = (const uint8_t*) picture->data[plane] + rowA * picture->stride[1];
+	const uint8_t *b = (const uint8_t*) picture->data[plane] + rowB * picture->stride[1];
+	int32_t i;
+
+	if (picture->p.bpc > 8)
+	{
+		for (i = 0; i < width; i += 1)
+		{
+			dst[i] = (uint16_t) (weightA * ((const uint16_t*) a)[i] + weightB * ((const uint16_t*) b)[i]);
+		}
+	}
+	else
+	{
+		for (i = 0; i < width; i += 1)
+		{
+			dst[i] = (uint16_t) (weightA * a[i] + weightB * b[i]);
+		}
+	}
+}
+
+/* AV1 chroma is always co-sited with the even luma columns. Doubles the scale. */
+static void INTERNAL_upsampleChromaRow(const uint16_t *src, int32_t width, uint16_t *dst)
+{
+	const int32_t last = (width - 1) >> 1;
+	int32_t i;
+
+	for (i = 0; i < (width >> 1); i += 1)
+	{
+		dst[i * 2] = (uint16_t) (src[i] * 2);
+		dst[i * 2 + 1] = (uint16_t) (src[i] + src[i < last ? i + 1 : last]);
+	}
+	if (width & 1)
+	{
+		dst[width - 1] = (uint16_t) (src[last] * 2);
+	}
+}
+
+/* Fills u and v with the chroma of luma row y, at full width. Interpolation
+ * doesn't round, the samples come out scaled by 1 << CHROMA_FRACTION_BITS instead.
+ */
+static void INTERNAL_chromaRow(
+	const RGBAConversion *conversion,
+	const Dav1dPicture *picture,
+	int32_t y,
+	uint16_t *u,
+	uint16_t *v,
+	uint16_t *halfU,
+	uint16_t *halfV
+) {
+	const int ssHor = picture->p.layout != DAV1D_PIXEL_LAYOUT_I444;
+	const int ssVer = picture->p.layout == DAV1D_PIXEL_LAYOUT_I420;
+	const int32_t chromaWidth = (picture->p.w + ssHor) >> ssHor;
+	const int32_t lastRow = ((picture->p.h + ssVer) >> ssVer) - 1;
+	int32_t row, other, i;
+	int weight;
+
+	if (picture->p.layout == DAV1D_PIXEL_LAYOUT_I400)
+	{
+		for (i = 0; i < picture->p.w; i += 1)
+		{
+			u[i] = (uint16_t) conversion->offsets[1];
+			v[i] = (uint16_t) conversion->offsets[2];
+		}
+		return;
+	}
+
+	row = y >> ssVer;
+	other = row;
+	weight = 4;
+
+	if (ssVer && conversion->chromaColocated)
+	{
+		/* Chroma sits on even rows, odd rows are halfway between two */
+		if (y & 1)
+		{
+			other = row < lastRow ? row + 1 : lastRow;
+			weight = 2;
+		}
+	}
+	else if (ssVer)
+	{
+		/* Chroma sits between two luma rows, a quarter away from each */
+		other = (y & 1) ? (row < lastRow ? row + 1 : lastRow) : (row > 0 ? row - 1 : 0);
+		weight = 3;
+	}
+
+	if (ssHor)
+	{
+		INTERNAL_blendChromaRows(picture, 1, row, other, weight, 4 - weight, chromaWidth, halfU);
+		INTERNAL_blendChromaRows(picture, 2, row, other, weight, 4 - weight, chromaWidth, halfV);
+		INTERNAL_upsampleChromaRow(halfU, picture->p.w, u);
+		INTERNAL_upsampleChromaRow(halfV, picture->p.w, v);
+	}
+	else
+	{
+		INTERNAL_blendChromaRows(picture, 1, row, other, weight * 2, 8 - weight * 2, chromaWidth, u);
+		INTERNAL_blendChromaRows(picture, 2, row, other, weight * 2, 8 - weight * 2, chromaWidth, v);
+	}
+}
+
+void df_INTERNAL_convertRGBA(
+	const RGBAConversion *conversion,
+	df_rgba_row_func rowFunc,
+	const Dav1dPicture *picture,
+	uint8_t *rgba,
+	uint32_t stride,
+	int32_t rowStart,
+	int32_t rowEnd,
+	uint16_t *scratch
+) {
+	const int32_t width = picture->p.w;
+	uint16_t *u = scratch;
+	uint16_t *v = scratch + width;
+	int32_t y;
+
+	for (y = rowStart; y < rowEnd; y += 1)
+	{
+		INTERNAL_chromaRow(conversion, picture, y, u, v, scratch + width * 2, scratch + width * 3);
+
+		rowFunc(
+			conversion,
+			(const uint8_t*) picture->data[0] + y * picture->stride[0],
+			u,
+			v,
+			rgba + (size_t) y * stride,
+			width
+		);
+	}
+}
+
+/* Semi-planar output */
+
+/* Monochrome comes out as 4:2:0 */
+static void INTERNAL_chromaSize(const Dav1dPicture *picture, int32_t *width, int32_t *height)
+{
+	*width = picture->p.layout == DAV1D_PIXEL_LAYOUT_I444 ? picture->p.w : (picture->p.w + 1) >> 1;
+	*height = picture->p.layout == DAV1D_PIXEL_LAYOUT_I444 || picture->p.layout == DAV1D_PIXEL_LAYOUT_I422 ?
+		picture->p.h :
+		(picture->p.h + 1) >> 1;
+}
+
+static void INTERNAL_interleaveRow8(const uint8_t *u, const uint8_t *v, uint8_t *uv, int32_t width)
+{
+	int32_t x = 0;
+
+#if defined(DF_HAVE_SSE2)
+	__m128i a, b;
+
+	for (; x + 16 <= width; x += 16)
+	{
+		a = _mm_loadu_si128((const __m128i*) (u + x));
+		b = _mm_loadu_si128((const __m128i*) (v + x));
+		_mm_storeu_si128((__m128i*) (uv + x * 2), _mm_unpacklo_epi8(a, b));
+		_mm_storeu_si128((__m128i*) (uv + x * 2 + 16), _mm_unpackhi_epi8(a, b));
+	}
+#elif defined(DF_HAVE_NEON)
+	uint8x16x2_t pair;
+
+	for (; x + 16 <= width; x += 16)
+	{
+		pair.val[0] = vld1q_u8(u + x);
+		pair.val[1] = vld1q_u8(v + x);
+		vst2q_u8(uv + x * 2, pair);
+	}
+#endif
+
+	for (; x < width; x += 1)
+	{
+		uv[x * 2] = u[x];
+		uv[x * 2 + 1] = v[x];
+	}
+}
+
+/* Moves samples to the top bits of each word, like P010 wants */
+static void INTERNAL_interleaveRow16(const uint16_t *u, const uint16_t *v, uint16_t *uv, int32_t width, int shift)
+{
+	int32_t x = 0;
+
+#if defined(DF_HAVE_SSE2)
+	const __m128i count = _mm_cvtsi32_si128(shift);
+	__m128i a, b;
+
+	for (; x + 8 <= width; x += 8)
+	{
+		a = _mm_sll_epi16(_mm_loadu_si128((const __m128i*) (u + x)), count);
+		b = _mm_sll_epi16(_mm_loadu_si128((const __m128i*) (v + x)), count);
+		_mm_storeu_si128((__m128i*) (uv + x * 2), _mm_unpacklo_epi16(a, b));
+		_mm_storeu_si128((__m128i*) (uv + x * 2 + 8), _mm_unpackhi_epi16(a, b));
+	}
+#elif defined(DF_HAVE_NEON)
+	const int16x8_t count = vdupq_n_s16((int16_t) shift);
+	uint16x8x2_t pair;
+
+	for (; x + 8 <= width; x += 8)
+	{
+		pair.val[0] = vshlq_u16(vld1q_u16(u + x), count);
+		pair.val[1] = vshlq_u16(vld1q_u16(v + x), count);
+		vst2q_u16(uv + x * 2, pair);
+	}
+#endif
+
+	for (; x < width; x += 1)
+	{
+		uv[x * 2] = (uint16_t) (u[x] << shift);
+		uv[x * 2 + 1] = (uint16_t) (v[x] << shift);
+	}
+}
+
+static void INTERNAL_shiftRow16(const uint16_t *src, uint16_t *dst, int32_t width, int shift)
+{
+	int32_t x = 0;
+
+#if defined(DF_HAVE_SSE2)
+	const __m128i count = _mm_cvtsi32_si128(shift);
+
+	for (; x + 8 <= width; x += 8)
+	{
+		_mm_storeu_si128(
+			(__m128i*) (dst + x),
+			_mm_sll_epi16(_mm_loadu_si128((const __m128i*) (src + x)), count)
+		);
+	}
+#elif defined(DF_HAVE_NEON)
+	const int16x8_t count = vdupq_n_s16((int16_t) shift);
+
+	for (; x + 8 <= width; x += 8)
+	{
+		vst1q_u16(dst + x, vshlq_u16(vld1q_u16(src + x), count));
+	}
+#endif
+
+	for (; x < width; x += 1)
+	{
+		dst[x] = (uint16_t) (src[x] << shift);
+	}
+}
+
+int df_INTERNAL_copySemiPlanar(
+	const Dav1dPicture *picture,
+	uint8_t *yData,
+	uint32_t yStride,
+	uint8_t *uvData,
+	uint32_t uvStride
+) {
+	const int hbd = picture->p.bpc > 8;
+	const int shift = hbd ? 16 - picture->p.bpc : 0;
+	const int32_t sampleSize = hbd ? 2 : 1;
+	const int32_t width = picture->p.w;
+	int32_t chromaWidth, chromaHeight, row, x;
+	uint16_t neutral;
+
+	INTERNAL_chromaSize(picture, &chromaWidth, &chromaHeight);
+
+	if (
+		picture->data[0] == NULL ||
+		yData == NULL ||
+		uvData == NULL ||
+		yStride < (uint32_t) (width * sampleSize) ||
+		uvStride < (uint32_t) (chromaWidth * 2 * sampleSize)
+	) {
+		return 0;
+	}
+
+	for (row = 0; row < picture->p.h; row += 1)
+	{
+		const uint8_t *src = (const uint8_t*) picture->data[0] + row * picture->stride[0];
+		uint8_t *dst = yData + (size_t) row * yStride;
+
+		if (hbd)
+		{
+			INTERNAL_shiftRow16((const uint16_t*) src, (uint16_t*) dst, width, shift);
+		}
+		else
+		{
+			memcpy(dst, src, width);
+		}
+	}
+
+	if (picture->p.layout == DAV1D_PIXEL_LAYOUT_I400)
+	{
+		neutral = (uint16_t) ((1 << (picture->p.bpc - 1)) << shift);
+
+		for (row = 0; row < chromaHeight; row += 1)
+		{
+			uint8_t *dst = uvData + (size_t) row * uvStride;
+
+			if (hbd)
+			{
+				for (x = 0; x < chromaWidth * 2; x += 1)
+				{
+					((uint16_t*) dst)[x] = neutral;
+				}
+			}
+			else
+			{
+				memset(dst, neutral, chromaWidth * 2);
+			}
+		}
+
+		return 1;
+	}
+
+	for (row = 0; row < chromaHeight; row += 1)
+	{
+		const uint8_t *u = (const uint8_t*) picture->data[1] + row * picture->stride[1];
+		const uint8_t *v = (const uint8_t*) picture->data[2] + row * picture->stride[1];
+		uint8_t *dst = uvData + (size_t) row * uvStride;
+
+		if (hbd)
+		{
+			INTERNAL_interleaveRow16((const uint16_t*) u, (const uint16_t*) v, (uint16_t*) dst, chromaWidth, shift);
+		}
+		else
+		{
+			INTERNAL_interleaveRow8(u, v, dst, chromaWidth);
+		}
+	}
+
+	return 1;
+}
+
+/* 8-bit output */
+
+/* 8x8 ordered dither, values 0 to 63 */
+static const uint8_t bayer8x8[8][8] =
+{
+	{  0, 32,  8, 40,  2, 34, 10, 42 },
+	{ 48, 16, 56, 24, 50, 18, 58, 26 },
+	{ 12, 44,  4, 36, 14, 46,  6, 38 },
+	{ 60, 28, 52, 20, 62, 30, 54, 22 },
+	{  3, 35, 11, 43,  1, 33,  9, 41 },
+	{ 51, 19, 59, 27, 49, 17, 57, 25 },
+	{ 15, 47,  7, 39, 13, 45,  5, 37 },
+	{ 63, 31, 55, 23, 61, 29, 53, 21 }
+};
+
+/* dst[x] = min((src[x] + bias[x & 7]) >> shift, 255) */
+static void INTERNAL_narrowRow(const uint16_t *src, uint8_t *dst, int32_t width, const uint16_t *bias, int shift)
+{
+	int32_t x = 0;
+
+#if defined(DF_HAVE_SSE2)
+	const __m128i count = _mm_cvtsi32_si128(shift);
+	const __m128i biases = _mm_loadu_si128((const __m128i*) bias);
+	__m128i low, high;
+
+	for (; x + 16 <= width; x += 16)
+	{
+		low = _mm_srl_epi16(_mm_add_epi16(_mm_loadu_si128((const __m128i*) (src + x)), biases), count);
+		high = _mm_srl_epi16(_mm_add_epi16(_mm_loadu_si128((const __m128i*) (src + x + 8)), biases), count);
+		_mm_storeu_si128((__m128i*) (dst + x), _mm_packus_epi16(low, high));
+	}
+#elif defined(DF_HAVE_NEON)
+	const int16x8_t count = vdupq_n_s16((int16_t) -shift);
+	const uint16x8_t biases = vld1q_u16(bias);
+
+	for (; x + 8 <= width; x += 8)
+	{
+		vst1_u8(dst + x, vqmovn_u16(vshlq_u16(vaddq_u16(vld1q_u16(src + x), biases), count)));
+	}
+#endif
+
+	for (; x < width; x += 1)
+	{
+		int32_t value = (src[x] + bias[x & 7]) >> shift;
+		dst[x] = (uint8_t) (value > 255 ? 255 : value);
+	}
+}
+
+static void INTERNAL_narrowPlane(
+	const Dav1dPicture *picture,
+	int plane,
+	int32_t width,
+	int32_t height,
+	uint8_t *data,
+	uint32_t stride,
+	int dither
+) {
+	const int shift = picture->p.bpc - 8;
+	const ptrdiff_t sourceStride = picture->stride[plane > 0];
+	uint16_t bias[8];
+	int32_t row, i;
+
+	for (row = 0; row < height; row += 1)
+	{
+		const uint8_t *src = (const uint8_t*) picture->data[plane] + row * sourceStride;
+		uint8_t *dst = data + (size_t) row * stride;
+
+		if (shift == 0)
+		{
+			memcpy(dst, src, width);
+			continue;
+		}
+
+		/* Without dither this is plain rounding */
+		for (i = 0; i < 8; i += 1)
+		{
+			bias[i] = dither ?
+				(uint16_t) (((2 * bayer8x8[row & 7][i] + 1) << shift) >> 7) :
+				(uint16_t) (1 << (shift - 1));
+		}
+
+		INTERNAL_narrowRow((const uint16_t*) src, dst, width, bias, shift);
+	}
+}
+
+int df_INTERNAL_copy8Bit(
+	const Dav1dPicture *picture,
+	uint8_t *yData,
+	uint8_t *uData,
+	uint8_t *vData,
+	uint32_t yStride,
+	uint32_t uvStride,
+	int dither
+) {
+	int32_t chromaWidth, chromaHeight, row;
+
+	INTERNAL_chromaSize(picture, &chromaWidth, &chromaHeight);
+
+	if (
+		picture->data[0] == NULL ||
+		yData == NULL ||
+		uData == NULL ||
+		vData == NULL ||
+		yStride < (uint32_t) picture->p.w ||
+		uvStride < (uint32_t) chromaWidth
+	) {
+		return 0;
+	}
+
+	INTERNAL_narrowPlane(picture, 0, picture->p.w, picture->p.h, yData, yStride, dither);
+
+	if (picture->p.layout == DAV1D_PIXEL_LAYOUT_I400)
+	{
+		for (row = 0; row < chromaHeight; row += 1)
+		{
+			memset(uData + (size_t) row * uvStride, 128, chromaWidth);
+			memset(vData + (size_t) row * uvStride, 128, chromaWidth);
+		}
+		return 1;
+	}
+
+	INTERNAL_narrowPlane(picture, 1, chromaWidth, chromaHeight, uData, uvStride, dither);
+	INTERNAL_narrowPlane(picture, 2, chromaWidth, chromaHeight, vData, uvStride, dither);
+
+	return 1;
+}
+
+/* Packed output */
+
+/* Copies this large stream past the cache, the caller uploads it and won't read it back */
+#define STREAM_COPY_BYTES (1 << 20)
+
+static void INTERNAL_copyRow(uint8_t *dst, const uint8_t *src, size_t size, int stream)
+{
+#if defined(DF_HAVE_SSE2)
+	size_t head, i;
+
+	if (stream)
+	{
+		head = (16 - ((uintptr_t) dst & 15)) & 15;
+		if (head > size)
+		{
+			head = size;
+		}
+
+		memcpy(dst, src, head);
+
+		for (i = head; i + 64 <= size; i += 64)
+		{
+			_mm_stream_si128((__m128i*) (dst + i), _mm_loadu_si128((const __m128i*) (src + i)));
+			_mm_stream_si128((__m128i*) (dst + i + 16), _mm_loadu_si128((const __m128i*) (src + i + 16)));
+			_mm_stream_si128((__m128i*) (dst + i + 32), _mm_loadu_si128((const __m128i*) (src + i + 32)));
+			_mm_stream_si128((__m128i*) (dst + i + 48), _mm_loadu_si128((const __m128i*) (src + i + 48)));
+		}
+		for (; i + 16 <= size; i += 16)
+		{
+			_mm_stream_si128((__m128i*) (dst + i), _mm_loadu_si128((const __m128i*) (src + i)));
+		}
+
+		memcpy(dst + i, src + i, size - i);
+		return;
+	}
+#else
+	(void) stream;
+#endif
+
+	memcpy(dst, src, size);
+}
+
+static void INTERNAL_copyPlane(
+	const uint8_t *src,
+	ptrdiff_t sourceStride,
+	uint8_t *dst,
+	uint32_t stride,
+	size_t rowSize,
+	int32_t height,
+	int stream
+) {
+	int32_t row;
+
+	if (sourceStride == (ptrdiff_t) stride && rowSize == stride)
+	{
+		INTERNAL_copyRow(dst, src, rowSize * height, stream);
+		return;
+	}
+
+	for (row = 0; row < height; row += 1)
+	{
+		INTERNAL_copyRow(dst + (size_t) row * stride, src + row * sourceStride, rowSize, stream);
+	}
+}
+
+int df_INTERNAL_copyPacked(
+	const Dav1dPicture *picture,
+	uint8_t *yData,
+	uint8_t *uData,
+	uint8_t *vData,
+	uint32_t alignment,
+	uint32_t *yDataLength,
+	uint32_t *uvDataLength,
+	uint32_t *yStride,
+	uint32_t *uvStride
+) {
+	const uint32_t sampleSize = picture->p.bpc > 8 ? 2 : 1;
+	const int hasChroma = picture->p.layout != DAV1D_PIXEL_LAYOUT_I400;
+	int32_t chromaWidth, chromaHeight;
+	uint32_t lumaRow, chromaRow;
+	int stream;
+
+	if (alignment == 0)
+	{
+		alignment = 1;
+	}
+
+	if (
+		picture->data[0] == NULL ||
+		yData == NULL ||
+		(hasChroma && (uData == NULL || vData == NULL)) ||
+		(alignment & (alignment - 1)) != 0
+	) {
+		return 0;
+	}
+
+	INTERNAL_chromaSize(picture, &chromaWidth, &chromaHeight);
+
+	lumaRow = picture->p.w * sampleSize;
+	chromaRow = hasChroma ? chromaWidth * sampleSize : 0;
+	*yStride = (lumaRow + alignment - 1) & ~(alignment - 1);
+	*uvStride = (chromaRow + alignment - 1) & ~(alignment - 1);
+	*yDataLength = *yStride * picture->p.h;
+	*uvDataLength = hasChroma ? *uvStride * chromaHeight : 0;
+
+	stream = (size_t) *yDataLength + 2 * (size_t) *uvDataLength >= STREAM_COPY_BYTES;
+
+	INTERNAL_copyPlane(
+		(const uint8_t*) picture->data[0],
+		picture->stride[0],
+		yData,
+		*yStride,
+		lumaRow,
+		picture->p.h,
+		stream
+	);
+
+	if (hasChroma)
+	{
+		INTERNAL_copyPlane((const uint8_t*) picture->data[1], picture->stride[1], uData, *uvStride, chromaRow, chromaHeight, stream);
+		INTERNAL_copyPlane((const uint8_t*) picture->data[2], picture->stride[1], vData, *uvStride, chromaRow, chromaHeight, stream);
+	}
+
+#if defined(DF_HAVE_SSE2)
+	if (stream)
+	{
+		/* Streaming stores aren't ordered with the ones that follow */
+		_mm_sfence();
+	}
+#endif
+
+	return 1;
+}
+
+/* Scaled output */
+
+/* dst[x] = average of the 2x2 block at rows a and b, column 2x */
+static void INTERNAL_halveRow8(const uint8_t *a, const uint8_t *b, uint8_t *dst, int32_t width)
+{
+	int32_t x = 0;
+
+#if defined(DF_HAVE_SSE2)
+	const __m128i mask = _mm_set1_epi16(0xFF);
+	const __m128i round = _mm_set1_epi16(2);
+	__m128i rowA, rowB, low, high;
+
+	for (; x + 16 <= width; x += 16)
+	{
+		rowA = _mm_loadu_si128((const __m128i*) (a + x * 2));
+		rowB = _mm_loadu_si128((const __m128i*) (b + x * 2));
+		low = _mm_add_epi16(
+			_mm_add_epi16(_mm_and_si128(rowA, mask), _mm_srli_epi16(rowA, 8)),
+			_mm_add_epi16(_mm_and_si128(rowB, mask), _mm_srli_epi16(rowB, 8))
+		);
+
+		rowA = _mm_loadu_si128((const __m128i*) (a + x * 2 + 16));
+		rowB = _mm_loadu_si128((const __m128i*) (b + x * 2 + 16));
+		high = _mm_add_epi16(
+			_mm_add_epi16(_mm_and_si128(rowA, mask), _mm_srli_epi16(rowA, 8)),
+			_mm_add_epi16(_mm_and_si128(rowB, mask), _mm_srli_epi16(rowB, 8))
+		);
+
+		_mm_storeu_si128(
+			(__m128i*) (dst + x),
+			_mm_packus_epi16(
+				_mm_srli_epi16(_mm_add_epi16(low, round), 2),
+				_mm_srli_epi16(_mm_add_epi16(high, round), 2)
+			)
+		);
+	}
+#elif defined(DF_HAVE_NEON)
+	for (; x + 8 <= width; x += 8)
+	{
+		vst1_u8(
+			dst + x,
+			vrshrn_n_u16(vaddq_u16(vpaddlq_u8(vld1q_u8(a + x * 2)), vpaddlq_u8(vld1q_u8(b + x * 2))), 2)
+		);
+	}
+#endif
+
+	for (; x < width; x += 1)
+	{
+		dst[x] = (uint8_t) ((a[x * 2] + a[x * 2 + 1] + b[x * 2] + b[x * 2 + 1] + 2) >> 2);
+	}
+}
+
+static void INTERNAL_halveRow16(const uint16_t *a, const uint16_t *b, uint16_t *dst, int32_t width)
+{
+	int32_t x = 0;
+
+#if defined(DF_HAVE_SSE2)
+	const __m128i ones = _mm_set1_epi16(1);
+	const __m128i round = _mm_set1_epi32(2);
+	__m128i low, high;
+
+	/* Samples are at most 12 bits, so madd's signed sums are safe */
+	for (; x + 8 <= width; x += 8)
+	{
+		low = _mm_add_epi32(
+			_mm_madd_epi16(_mm_loadu_si128((const __m128i*) (a + x * 2)), ones),
+			_mm_madd_epi16(_mm_loadu_si128((const __m128i*) (b + x * 2)), ones)
+		);
+		high = _mm_add_epi32(
+			_mm_madd_epi16(_mm_loadu_si128((const __m128i*) (a + x * 2 + 8)), ones),
+			_mm_madd_epi16(_mm_loadu_si128((const __m128i*) (b + x * 2 + 8)), ones)
+		);
+
+		_mm_storeu_si128(
+			(__m128i*) (dst + x),
+			_mm_packs_epi32(
+				_mm_srai_epi32(_mm_add_epi32(low, round), 2),
+				_mm_srai_epi32(_mm_add_epi32(high, round), 2)
+			)
+		);
+	}
+#elif defined(DF_HAVE_NEON)
+	for (; x + 4 <= width; x += 4)
+	{
+		vst1_u16(
+			dst + x,
+			vrshrn_n_u32(vaddq_u32(vpaddlq_u16(vld1q_u16(a + x * 2)), vpaddlq_u16(vld1q_u16(b + x * 2))), 2)
+		);
+	}
+#endif
+
+	for (; x < width; x += 1)
+	{
+		dst[x] = (uint16_t) ((a[x * 2] + a[x * 2 + 1] + b[x * 2] + b[x * 2 + 1] + 2) >> 2);
+	}
+}
+
+/* Averages the source block each output sample covers. acc needs sourceWidth entries. */
+static void INTERNAL_boxPlane(
+	const uint8_t *src,
+	ptrdiff_t sourceStride,
+	int32_t sourceWidth,
+	int32_t sourceHeight,
+	uint8_t *dst,
+	uint32_t stride,
+	int32_t width,
+	int32_t height,
+	int hbd,
+	uint32_t *acc
+) {
+	int32_t row, top, bottom, left, right, x, i;
+	uint64_t sum, count; /* a whole block, 4K of 12 bit samples overflow 32 bits */
+
+	for (row = 0; row < height; row += 1)
+	{
+		top = (int32_t) ((int64_t) row * sourceHeight / height);
+		bottom = (int32_t) ((int64_t) (row + 1) * sourceHeight / height);
+
+		memset(acc, 0, sizeof(uint32_t) * sourceWidth);
+		for (i = top; i < bottom; i += 1)
+		{
+			const uint8_t *line = src + i * sourceStride;
+
+			if (hbd)
+			{
+				for (x = 0; x < sourceWidth; x += 1)
+				{
+					acc[x] += ((const uint16_t*) line)[x];
+				}
+			}
+			else
+			{
+				for (x = 0; x < sourceWidth; x += 1)
+				{
+					acc[x] += line[x];
+				}
+			}
+		}
+
+		for (x = 0; x < width; x += 1)
+		{
+			left = (int32_t) ((int64_t) x * sourceWidth / width);
+			right = (int32_t) ((int64_t) (x + 1) * sourceWidth / width);
+			count = (uint64_t) (right - left) * (uint64_t) (bottom - top);
+
+			sum = 0;
+			for (i = left; i < right; i += 1)
+			{
+				sum += acc[i];
+			}
+			sum = (sum + count / 2) / count;
+
+			if (hbd)
+			{
+				((uint16_t*) (dst + (size_t) row * stride))[x] = (uint16_t) sum;
+			}
+			else
+			{
+				dst[(size_t) row * stride + x] = (uint8_t) sum;
+			}
+		}
+	}
+}
+
+static void INTERNAL_scalePlane(
+	const uint8_t *src,
+	ptrdiff_t sourceStride,
+	int32_t sourceWidth,
+	int32_t sourceHeight,
+	uint8_t *dst,
+	uint32_t stride,
+	int32_t width,
+	int32_t height,
+	int hbd,
+	uint32_t *acc
+) {
+	int32_t row;
+
+	if (sourceWidth / 2 != width || sourceHeight / 2 != height)
+	{
+		INTERNAL_boxPlane(src, sourceStride, sourceWidth, sourceHeight, dst, stride, width, height, hbd, acc);
+		return;
+	}
+
+	/* Exact halving, an odd last row or column is left out */
+	for (row = 0; row < height; row += 1)
+	{
+		const uint8_t *a = src + row * 2 * sourceStride;
+
+		if (hbd)
+		{
+			INTERNAL_halveRow16(
+				(const uint16_t*) a,
+				(const uint16_t*) (a + sourceStride),
+				(uint16_t*) (dst + (size_t) row * stride),
+				width
+			);
+		}
+		else
+		{
+			INTERNAL_halveRow8(a, a + sourceStride, dst + (size_t) row * stride, width);
+		}
+	}
+}
+
+static void INTERNAL_fillPlane(uint8_t *data, uint32_t stride, int32_t width, int32_t height, int hbd, uint16_t value)
+{
+	int32_t row, x;
+
+	for (row = 0; row < height; row += 1)
+	{
+		uint8_t *dst = data + (size_t) row * stride;
+
+		if (hbd)
+		{
+			for (x = 0; x < width; x += 1)
+			{
+				((uint16_t*) dst)[x] = value;
+			}
+		}
+		else
+		{
+			memset(dst, value, width);
+		}
+	}
+}
+
+int df_INTERNAL_copyScaled(
+	const Dav1dPicture *picture,
+	uint8_t *yData,
+	uint8_t *uData,
+	uint8_t *vData,
+	int32_t width,
+	int32_t height,
+	uint32_t yStride,
+	uint32_t uvStride,
+	uint32_t *scratch
+) {
+	const int hbd = picture->p.bpc > 8;
+	const int32_t sampleSize = hbd ? 2 : 1;
+	Dav1dPicture scaled;
+	int32_t sourceChromaWidth, sourceChromaHeight, chromaWidth, chromaHeight;
+
+	/* Chroma keeps the picture's subsampling at the new size */
+	scaled.p = picture->p;
+	scaled.p.w = width;
+	scaled.p.h = height;
+	INTERNAL_chromaSize(picture, &sourceChromaWidth, &sourceChromaHeight);
+	INTERNAL_chromaSize(&scaled, &chromaWidth, &chromaHeight);
+
+	if (
+		picture->data[0] == NULL ||
+		yData == NULL ||
+		uData == NULL ||
+		vData == NULL ||
+		width <= 0 ||
+		height <= 0 ||
+		width > picture->p.w ||
+		height > picture->p.h ||
+		yStride < (uint32_t) (width * sampleSize) ||
+		uvStride < (uint32_t) (chromaWidth * sampleSize)
+	) {
+		return 0;
+	}
+
+	INTERNAL_scalePlane(
+		(const uint8_t*) picture->data[0],
+		picture->stride[0],
+		picture->p.w,
+		picture->p.h,
+		yData,
+		yStride,
+		width,
+		height,
+		hbd,
+		scratch
+	);
+
+	if (picture->p.layout == DAV1D_PIXEL_LAYOUT_I400)
+	{
+		INTERNAL_fillPlane(uData, uvStride, chromaWidth, chromaHeight, hbd, (uint16_t) (1 << (picture->p.bpc - 1)));
+		INTERNAL_fillPlane(vData, uvStride, chromaWidth, chromaHeight, hbd, (uint16_t) (1 << (picture->p.bpc - 1)));
+		return 1;
+	}
+
+	INTERNAL_scalePlane(
+		(const uint8_t*) picture->data[1],
+		picture->stride[1],
+		sourceChromaWidth,
+		sourceChromaHeight,
+		uData,
+		uvStride,
+		chromaWidth,
+		chromaHeight,
+		hbd,
+		scratch
+	);
+	INTERNAL_scalePlane(
+		(const uint8_t*) picture->data[2],
+		picture->stride[1],
+		sourceChromaWidth,
+		sourceChromaHeight,
+		vData,
+		uvStride,
+		chromaWidth,
+		chromaHeight,
+		hbd,
+		scratch
+	);
+
+	return 1;
+}
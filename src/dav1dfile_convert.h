@@ -0,0 +1,134 @@
+/* dav1dfile - AV1 Video Decoder Library
+ *
+ * Copyright (c) 2023 Evan Hemsley
+ *
+ * This software is provided 'as-is', without any express or implied warranty.
+ * In no event will the authors be held liable for any damages arising from
+ * the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ * claim that you wrote the original software. If you use this software in a
+ * product, an acknowledgment in the product documentation would be
+ * appreciated but is not required.
+ *
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ * misrepresented as being the original software.
+ *
+ * 3. This notice may not be removed or altered from any source distribution.
+ *
+ * Evan "cosmonaut" Hemsley <evan@moonside.games>
+ *
+ */
+
+/* Pixel format conversion of decoded pictures, shared by the output functions */
+
+#ifndef DAV1DFILE_CONVERT_H
+#define DAV1DFILE_CONVERT_H
+
+#include "dav1dfile.h"
+
+/* Per-picture constants for the row kernels.
+ * Samples are made signed and scaled to 15 bits, a = (sample - offset) << shift,
+ * then each output channel is the sum of (a * coefficient) >> 16 over Y, U and V,
+ * with 4 fractional bits left for rounding.
+ */
+typedef struct RGBAConversion
+{
+	int16_t coefficients[3][3]; /* R, G, B rows, Y, U, V columns */
+	int16_t offsets[3];         /* Y, U, V */
+	int16_t shift;
+	int16_t chromaShift;        /* upsampled chroma has fractional bits already */
+	uint8_t bgra;
+	uint8_t hbd;                /* samples are 16 bit */
+	uint8_t chromaColocated;    /* chroma is sited on the luma row, not between rows */
+} RGBAConversion;
+
+/* One output row. U and V are full width and carry a few fractional bits. */
+typedef void (*df_rgba_row_func)(
+	const RGBAConversion *conversion,
+	const void *y,
+	const uint16_t *u,
+	const uint16_t *v,
+	uint8_t *rgba,
+	int32_t width
+);
+
+void df_INTERNAL_setupRGBA(const Dav1dPicture *picture, RGBAFormat format, RGBAConversion *conversion);
+
+/* The fastest kernel this CPU can run */
+df_rgba_row_func df_INTERNAL_rgbaRowFunc(void);
+
+/* Converts rows [rowStart, rowEnd) of the picture. scratch needs room for
+ * 4 * picture width samples.
+ */
+void df_INTERNAL_convertRGBA(
+	const RGBAConversion *conversion,
+	df_rgba_row_func rowFunc,
+	const Dav1dPicture *picture,
+	uint8_t *rgba,
+	uint32_t stride,
+	int32_t rowStart,
+	int32_t rowEnd,
+	uint16_t *scratch
+);
+
+/* Copies the picture out with U and V interleaved, high bit depth samples
+ * moved to the top bits. Returns 0 if the strides are too small.
+ */
+int df_INTERNAL_copySemiPlanar(
+	const Dav1dPicture *picture,
+	uint8_t *yData,
+	uint32_t yStride,
+	uint8_t *uvData,
+	uint32_t uvStride
+);
+
+/* Copies the picture out as 8-bit planes, rounding or dithering high bit
+ * depth samples. Returns 0 if the strides are too small.
+ */
+int df_INTERNAL_copy8Bit(
+	const Dav1dPicture *picture,
+	uint8_t *yData,
+	uint8_t *uData,
+	uint8_t *vData,
+	uint32_t yStride,
+	uint32_t uvStride,
+	int dither
+);
+
+/* Copies the visible part of each plane, rows padded to alignment bytes.
+ * Returns 0 if alignment isn't a power of two.
+ */
+int df_INTERNAL_copyPacked(
+	const Dav1dPicture *picture,
+	uint8_t *yData,
+	uint8_t *uData,
+	uint8_t *vData,
+	uint32_t alignment,
+	uint32_t *yDataLength,
+	uint32_t *uvDataLength,
+	uint32_t *yStride,
+	uint32_t *uvStride
+);
+
+/* Copies the picture out box filtered down to width x height, exact halving
+ * has its own kernels. scratch needs room for picture width entries.
+ * Returns 0 if the size is larger than the picture or the strides too small.
+ */
+int df_INTERNAL_copyScaled(
+	const Dav1dPicture *picture,
+	uint8_t *yData,
+	uint8_t *uData,
+	uint8_t *vData,
+	int32_t width,
+	int32_t height,
+	uint32_t yStride,
+	uint32_t uvStride,
+	uint32_t *scratch
+);
+
+#endif /* DAV1DFILE_CONVERT_H */
@@ -1161,7 +1161,7 @@
          if (fh->buffer_removal_time_present_flag) {
              for (uint8_t opNum = 0; opNum <= seq->operating_points_cnt_minus_1; opNum++) {
                  if (seq->decoder_model_present_for_this_op[opNum]) {
-                     uint8_t opPtIdc = seq->operating_point_idc[opNum];
+                     uint16_t opPtIdc = seq->operating_point_idc[opNum];
                      int inTemporalLayer = (opPtIdc >> temporal_id) & 1;
                      int inSpatialLayer = (opPtIdc >> (spatial_id + 8)) & 1;
                      if (opPtIdc == 0 || (inTemporalLayer && inSpatialLayer)) {
@@ -172,7 +172,7 @@
      } decoder_model_info;
      int initial_display_delay_present_flag;
      uint8_t operating_points_cnt_minus_1;
-     uint8_t operating_point_idc[32];
+     uint16_t operating_point_idc[32];
      uint8_t seq_level_idx[32];
      uint8_t seq_tier[32];
      int decoder_model_present_for_this_op[32];